@@ -73,6 +73,22 @@ struct dos_dir_entry {
   __u32 size;			/**< file size (in bytes)                */
 } __attribute__ ((packed));
 
+/** Metadata of one directory entry as returned by fs_stat_dir and fs_walk */
+struct fs_stat {
+  char  name[13];               /**< "NAME.EXT" (without padding)        */
+  int   parent;                 /**< index of the parent directory in
+                                 *   the result array, -1 if the entry is
+                                 *   a child of the directory walked     */
+  __u8  attr;                   /**< attribute bits                      */
+  __u32 size;                   /**< file size (in bytes)                */
+  __u16 start;                  /**< first cluster of the file           */
+  __u16 ctime;                  /**< creation time                       */
+  __u16 cdate;                  /**< creation date                       */
+  __u16 adate;                  /**< last access date                    */
+  __u16 time;                   /**< last modified or created            */
+  __u16 date;                   /**< date                                */
+};
+
 /** @def FILE_ATTR_RONLY
  * File is read only */
 #define FILE_ATTR_RONLY     1
@@ -142,8 +158,33 @@ int fs_creat(const char *path);
 /* input/output: as the linux read() function */
 int fs_read(int fd, void *buffer, int len);
 
+/* input: file descriptor, maximal number of bytes to read
+   output: view points to the bytes in the driver's cache
+   return: number of bytes in the view (as read()), the view stays valid
+   until fs_release_view is called. Every view has to be released before
+   fs_close: while views are pinned fs_write fails and fs_close prints an
+   error and leaves the file open */
+int fs_read_view(int fd, const void **view, int len);
+
+/* gives back a view handed out by fs_read_view */
+void fs_release_view(int fd, const void *view);
+
 /* input/output: as the linux write() function */
 int fs_write(int fd, void *buffer, int len);
 
-/* closes the file with the specified descriptor*/
+/* closes the file with the specified descriptor (unless views of
+   fs_read_view are still pinned, see there) */
 void fs_close(int fd);
+
+/* input: the path of a directory ("" or "/" for the root directory),
+   an array for at most max_entries results
+   output: the metadata of all children of the directory
+   return: number of children of the directory or -1 if path is not a
+   directory. If this is more than max_entries the array was too small:
+   only the first max_entries were stored, call again with a bigger array */
+int fs_stat_dir(const char *path, struct fs_stat *stats, int max_entries);
+
+/* as fs_stat_dir but recursively for the whole tree below path,
+   the parent field links every entry to its directory in stats.
+   The return value counts the whole tree, also if it was truncated */
+int fs_walk(const char *path, struct fs_stat *stats, int max_entries);
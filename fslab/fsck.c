@@ -0,0 +1,471 @@
+/* FAT12 Checker and Defragmenter
+ * ====================
+ * fsck walks the directory tree of a FAT12 image (using the helpers
+ * of our driver in fsdriver.c) and checks the following invariants:
+ * 	1. Every cluster chain ends with an end of chain marker and only
+ * 	   contains valid data clusters (no free or bad clusters, no loops).
+ * 	2. No cluster belongs to more than one chain (cross-linked clusters).
+ * 	3. The chain of a file is long enough to hold the file size.
+ * 	4. All FAT copies are identical.
+ * 	5. Every used cluster in the FAT belongs to a file or a directory
+ * 	   (otherwise it is reported as a lost cluster).
+ * Along the way it counts the number of extents (contiguous cluster
+ * runs) per file and reports how fragmented the image is.
+ *
+ * With -d the image is defragmented after a successful check: all
+ * cluster chains are loaded into memory and rewritten as contiguous
+ * extents starting at the first data cluster, in the order in which
+ * we visit them (breadth first, so directories end up close to their
+ * children). Start clusters in the directory entries (including the
+ * "." and ".." entries of subdirectories) are patched accordingly.
+ * We refuse to defragment an image which has errors.
+ *
+ * Known Limitations
+ * ====================
+ * - Long file name entries are skipped (as in the driver).
+ * - Lost clusters are only reported, not reclaimed.
+ * - The whole content of the image is held in memory while defragmenting,
+ *   which is fine for floppy sized FAT12 images.
+ *
+ * Authors
+ * ====================
+ * team07:
+ * Boris Bluntschli (borisb@student.ethz.ch)
+ * Gerd Zellweger (zgerd@student.ethz.ch)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include "fsdriver.h"
+
+#define MAX_PATH_LENGTH 255
+#define NO_OWNER        -1
+
+// A file or directory reachable from the root directory
+struct fs_object {
+	char path[MAX_PATH_LENGTH+1];
+	directory_entry_ptr entry; // points into the directory data of the parent
+	int parent;                // index of the parent object or -1 for the root directory
+	int cluster_count;         // length of the (valid part of the) cluster chain
+	int extents;               // number of contiguous cluster runs in the chain
+	int new_start;             // start cluster after defragmentation
+	data_ptr contents;         // chain contents, loaded for directories and by defrag
+};
+typedef struct fs_object* fs_object_ptr;
+
+static struct fs_object* objects = NULL;
+static int object_count = 0;
+static int object_capacity = 0;
+
+static int* owner = NULL;      // owner[c] is the object index using cluster c
+static int max_cluster = 0;    // highest valid data cluster number
+static data_ptr root_directory = NULL;
+
+static int errors = 0;
+static int warnings = 0;
+static boolean verbose = FALSE;
+
+
+/** Prints an error found in the image and counts it. */
+#define REPORT_ERROR(fmt, args...)   { errors++; printf("error: " fmt "\n", ## args); }
+
+/** Prints a warning about the image and counts it. */
+#define REPORT_WARNING(fmt, args...) { warnings++; printf("warning: " fmt "\n", ## args); }
+
+
+/** Prints the usage message and exits.
+ */
+static void usage() {
+	fprintf(stderr, "Usage: ./fsck [-v] [-d] image\n");
+	fprintf(stderr, "\t-v  print the extents of every file\n");
+	fprintf(stderr, "\t-d  defragment the image if it has no errors\n");
+	exit(EXIT_FAILURE);
+}
+
+
+/** Appends a new object to the object table.
+ *  @param entry directory entry of the object (in the parent's directory data)
+ *  @param parent index of the parent directory object or -1 for the root directory
+ *  @return index of the new object
+ */
+static int add_object(directory_entry_ptr entry, int parent) {
+
+	if(object_count == object_capacity) {
+		object_capacity = (object_capacity == 0) ? 64 : 2*object_capacity;
+		objects = realloc(objects, object_capacity*sizeof(struct fs_object));
+		if(objects == NULL) {
+			die("Error: out of memory\n");
+		}
+	}
+
+	fs_object_ptr obj = &objects[object_count];
+	obj->entry = entry;
+	obj->parent = parent;
+	obj->cluster_count = 0;
+	obj->extents = 0;
+	obj->new_start = 0;
+	obj->contents = NULL;
+
+	// generate "DIR/NAME.EXT" without the space padding of the entry
+	char name[MAX_PATH_LENGTH];
+	format_entry_name(entry, name);
+
+	if(parent == -1)
+		snprintf(obj->path, sizeof(obj->path), "%s", name);
+	else
+		snprintf(obj->path, sizeof(obj->path), "%s/%s", objects[parent].path, name);
+
+	return object_count++;
+}
+
+
+/** Follows the cluster chain of an object and marks all its clusters
+ *  as owned by the object. Reports invalid clusters, loops and cross-linked
+ *  clusters. We stop following a chain at the first error.
+ *  @param index of the object
+ *  @return TRUE if the chain is valid
+ */
+static boolean walk_chain(int index) {
+	fs_object_ptr obj = &objects[index];
+	int cluster = obj->entry->start;
+	int prev = -1;
+
+	if(cluster == 0) {
+		return TRUE; // empty file without any clusters
+	}
+
+	while(!IS_LAST_CLUSTER(cluster)) {
+
+		if(cluster < FIRST_DATA_CLUSTER || cluster > max_cluster) {
+			REPORT_ERROR("%s: invalid cluster %d in chain (after cluster %d)", obj->path, cluster, prev);
+			return FALSE;
+		}
+		if(owner[cluster] == index) {
+			REPORT_ERROR("%s: chain loops back to cluster %d", obj->path, cluster);
+			return FALSE;
+		}
+		if(owner[cluster] != NO_OWNER) {
+			REPORT_ERROR("%s: cluster %d is cross-linked with %s", obj->path, cluster, objects[owner[cluster]].path);
+			return FALSE;
+		}
+
+		owner[cluster] = index;
+		if(prev == -1 || cluster != prev+1)
+			obj->extents++;
+		obj->cluster_count++;
+
+		prev = cluster;
+		cluster = get_next_cluster_nr(cluster);
+	}
+
+	if(cluster == BAD_CLUSTER) {
+		REPORT_ERROR("%s: chain runs into bad cluster (after cluster %d)", obj->path, prev);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/** Loads the contents of a (previously walked) cluster chain into memory.
+ *  @param obj object to load the contents for
+ */
+static void load_chain_contents(fs_object_ptr obj) {
+	obj->contents = malloc(max(obj->cluster_count, 1) * cluster_size);
+	if(obj->contents == NULL) {
+		die("Error: out of memory\n");
+	}
+
+	int cluster = obj->entry->start;
+	int i;
+	for(i=0; i<obj->cluster_count; i++) {
+		load_cluster(cluster, obj->contents + i*cluster_size);
+		cluster = get_next_cluster_nr(cluster);
+	}
+}
+
+
+/** Adds all entries found in `directory_data` to the object table.
+ *  Deleted entries, long file name entries, volume labels and the
+ *  "." and ".." entries of subdirectories are skipped.
+ *  @param directory_data contents of the directory
+ *  @param entries number of entries that fit into directory_data
+ *  @param parent index of the directory object or -1 for the root directory
+ */
+static void add_directory_entries(data_ptr directory_data, int entries, int parent) {
+
+	directory_entry_ptr entry = (directory_entry_ptr) directory_data;
+	int i;
+	for(i=0; i<entries && IS_VALID_ENTRY(entry); i++, entry++) {
+
+		if(IS_CHILD_ENTRY(entry))
+			add_object(entry, parent);
+	}
+}
+
+
+/** Walks the directory tree breadth first and checks all cluster chains.
+ *  Note: The object table grows while we iterate over it, that's why
+ *  we always access objects by their index.
+ */
+static void check_tree() {
+	root_directory = malloc(root_dir_sectors*fbs.sector_size);
+	load_root_directory(root_directory);
+	add_directory_entries(root_directory, fbs.dir_entries, -1);
+
+	int i;
+	for(i=0; i<object_count; i++) {
+		if(!walk_chain(i))
+			continue;
+
+		fs_object_ptr obj = &objects[i];
+		if(IS_DIRECTORY(obj->entry)) {
+			load_chain_contents(obj);
+			add_directory_entries(objects[i].contents, objects[i].cluster_count*cluster_size / sizeof(directory_entry), i);
+		}
+		else {
+			int needed = (obj->entry->size + cluster_size - 1) / cluster_size;
+			if(obj->cluster_count < needed)
+				REPORT_ERROR("%s: chain has %d clusters but file size %u needs %d", obj->path, obj->cluster_count, obj->entry->size, needed);
+			if(obj->cluster_count > max(needed, 1))
+				REPORT_WARNING("%s: chain has %d clusters but file size %u needs only %d", obj->path, obj->cluster_count, obj->entry->size, needed);
+		}
+
+		if(verbose) {
+			printf("%s: %d clusters in %d extents\n", objects[i].path, objects[i].cluster_count, objects[i].extents);
+		}
+	}
+}
+
+
+/** Compares all FAT copies with FAT1 entry by entry.
+ */
+static void check_fat_copies() {
+	int which;
+	for(which=2; which<=fbs.fats; which++) {
+		data_ptr fat = load_fat(which);
+
+		int mismatches = 0;
+		int cluster;
+		for(cluster=0; cluster<=max_cluster; cluster++) {
+			if(get_fat_entry(fat, cluster) != get_next_cluster_nr(cluster)) {
+				if(verbose || mismatches == 0)
+					printf("FAT1 and FAT%d differ at cluster %d (0x%03x vs 0x%03x)\n",
+					       which, cluster, get_next_cluster_nr(cluster), get_fat_entry(fat, cluster));
+				mismatches++;
+			}
+		}
+		if(mismatches > 0)
+			REPORT_ERROR("FAT1 and FAT%d differ in %d entries", which, mismatches);
+
+		free(fat);
+	}
+}
+
+
+/** Finds used clusters in FAT1 which are not part of any chain.
+ */
+static void check_lost_clusters() {
+	int lost = 0;
+	int cluster;
+	for(cluster=FIRST_DATA_CLUSTER; cluster<=max_cluster; cluster++) {
+		int next = get_next_cluster_nr(cluster);
+		if(next != 0 && next != BAD_CLUSTER && owner[cluster] == NO_OWNER) {
+			if(verbose)
+				printf("cluster %d is lost\n", cluster);
+			lost++;
+		}
+	}
+	if(lost > 0)
+		REPORT_ERROR("%d lost clusters", lost);
+}
+
+
+/** Prints usage and fragmentation statistics of the image.
+ */
+static void print_summary() {
+	int files = 0, directories = 0, fragmented = 0, extents = 0;
+	int used = 0, bad = 0;
+
+	int i;
+	for(i=0; i<object_count; i++) {
+		if(IS_DIRECTORY(objects[i].entry))
+			directories++;
+		else
+			files++;
+		if(objects[i].extents > 1)
+			fragmented++;
+		extents += objects[i].extents;
+	}
+
+	int cluster;
+	for(cluster=FIRST_DATA_CLUSTER; cluster<=max_cluster; cluster++) {
+		if(get_next_cluster_nr(cluster) == BAD_CLUSTER)
+			bad++;
+		else if(owner[cluster] != NO_OWNER)
+			used++;
+	}
+
+	printf("%d files, %d directories\n", files, directories);
+	printf("%d/%d clusters used (%d bad), cluster size %d bytes\n",
+	       used, max_cluster-FIRST_DATA_CLUSTER+1, bad, cluster_size);
+	printf("%d fragmented objects, %d extents in total\n", fragmented, extents);
+	printf("%d errors, %d warnings\n", errors, warnings);
+}
+
+
+/** Rewrites every cluster chain as one contiguous extent.
+ *  This assumes that check_tree has walked all chains without errors.
+ *  @return number of objects which have been moved
+ */
+static int defragment() {
+	int i;
+
+	// 1. load everything into memory (directories are already loaded)
+	for(i=0; i<object_count; i++) {
+		if(objects[i].contents == NULL)
+			load_chain_contents(&objects[i]);
+	}
+
+	// 2. assign new contiguous extents in visiting order, skipping bad clusters
+	int next_free = FIRST_DATA_CLUSTER;
+	for(i=0; i<object_count; i++) {
+		fs_object_ptr obj = &objects[i];
+		if(obj->cluster_count == 0)
+			continue;
+
+		int run = 0;
+		while(run < obj->cluster_count) {
+			assert(next_free + run <= max_cluster); // we reuse the same number of clusters
+			if(get_next_cluster_nr(next_free + run) == BAD_CLUSTER) {
+				next_free += run+1;
+				run = 0;
+			}
+			else {
+				run++;
+			}
+		}
+		obj->new_start = next_free;
+		next_free += obj->cluster_count;
+	}
+
+	// 3. patch the start clusters in the directory entries
+	int moved = 0;
+	for(i=0; i<object_count; i++) {
+		fs_object_ptr obj = &objects[i];
+		if(obj->cluster_count == 0)
+			continue;
+		if(obj->entry->start != obj->new_start || obj->extents > 1)
+			moved++;
+
+		obj->entry->start = obj->new_start;
+
+		if(IS_DIRECTORY(obj->entry)) {
+			int parent_start = (obj->parent == -1) ? 0 : objects[obj->parent].new_start;
+			directory_entry_ptr entry = (directory_entry_ptr) obj->contents;
+			int j;
+			for(j=0; j<2 && IS_VALID_ENTRY(&entry[j]); j++) {
+				if(memcmp(entry[j].name, ".       ", 8) == 0)
+					entry[j].start = obj->new_start;
+				else if(memcmp(entry[j].name, "..      ", 8) == 0)
+					entry[j].start = parent_start;
+			}
+		}
+	}
+
+	// 4. rebuild the FAT (keeping bad cluster markers)
+	int cluster;
+	for(cluster=FIRST_DATA_CLUSTER; cluster<=max_cluster; cluster++) {
+		if(get_next_cluster_nr(cluster) != BAD_CLUSTER)
+			set_next_cluster(cluster, 0);
+	}
+	for(i=0; i<object_count; i++) {
+		fs_object_ptr obj = &objects[i];
+		int j;
+		for(j=0; j<obj->cluster_count; j++) {
+			int next = (j == obj->cluster_count-1) ? LAST_CLUSTER : obj->new_start+j+1;
+			set_next_cluster(obj->new_start+j, next);
+		}
+	}
+
+	// 5. write everything back
+	for(i=0; i<object_count; i++) {
+		fs_object_ptr obj = &objects[i];
+		int j;
+		for(j=0; j<obj->cluster_count; j++) {
+			write_cluster(obj->new_start+j, obj->contents + j*cluster_size);
+		}
+	}
+	write_root_directory(root_directory);
+	write_all_fats(FAT1);
+
+	return moved;
+}
+
+
+/**
+ * main routine: checks and optionally defragments an image
+ * @param argc number of arguments
+ * @param argv command line arguments
+ * @return     0 if the image has no errors
+ */
+int main(int argc, char **argv) {
+	boolean defrag = FALSE;
+	int c;
+
+	while((c = getopt(argc, argv, "vdh")) != -1) {
+		switch(c) {
+		case 'v':
+			verbose = TRUE;
+			break;
+		case 'd':
+			defrag = TRUE;
+			break;
+		default:
+			usage();
+		}
+	}
+	if(optind != argc-1) {
+		usage();
+	}
+
+	printf("Checking image: %s\n", argv[optind]);
+	bios_init(argv[optind]);
+	fs_init();
+
+	max_cluster = FIRST_DATA_CLUSTER + get_data_cluster_count() - 1;
+	owner = malloc((max_cluster+1) * sizeof(int));
+	int i;
+	for(i=0; i<=max_cluster; i++) {
+		owner[i] = NO_OWNER;
+	}
+
+	check_tree();
+	check_fat_copies();
+	check_lost_clusters();
+	print_summary();
+
+	if(defrag) {
+		if(errors > 0) {
+			printf("Not defragmenting an image with errors\n");
+		}
+		else {
+			printf("Defragmenting: %d objects moved\n", defragment());
+		}
+	}
+
+	bios_shutdown();
+
+	for(i=0; i<object_count; i++) {
+		free(objects[i].contents);
+	}
+	free(objects);
+	free(owner);
+	free(root_directory);
+	free(FAT1);
+
+	exit(errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -6,7 +6,9 @@
  * be created to keep track of the associated information for the file.
  * On the first fs_read call the buffer in the file_table_entry is loaded
  * with the file contents and the bytes we want to read are copied in the
- * client buffer.
+ * client buffer. Clients which can consume the data in place use
+ * fs_read_view instead, which hands out a pointer into that buffer and
+ * pins it until the view is given back with fs_release_view.
  * On a fs_write call we overwrite the buffer and write it to disk (including
  * updating the corresponding `directory_entry`). This is done by storing the
  * cluster number of the corresponding directory in the file table entry.
@@ -18,7 +20,8 @@
  * - Code can not create directories.
  * - The path length is limited to 255 (MAX_PATH_LENGTH) characters since strtok cannot handle const char* directly
  * - Filename length is limited to 13 characters (MAX_FILENAME_LENGTH)
- * - The code assumes that every non-root directory only has one cluster.
+ * - The code assumes that every non-root directory only has one cluster (except
+ *   for fs_stat_dir and fs_walk, which follow the cluster chain of directories).
  *   This limits the number of files per directory to sizeof(dos_dir_entry) / cluster_size.
  * - A directory entry whose name starts with byte 0x0 is available and marks the end
  *   of the corresponding directory table.
@@ -35,19 +38,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include "fs.h"
-
-// Some basic types & macros
-typedef int boolean;
-#define TRUE 1
-#define FALSE 0
-typedef unsigned int uint;
-typedef unsigned char data;
-typedef unsigned char* data_ptr;
-
-// Types needed for our FAT Implementation
-typedef struct dos_dir_entry  directory_entry;
-typedef struct dos_dir_entry* directory_entry_ptr;
+#include "fsdriver.h"
 
 // internal file handle representation
 struct file_table_entry {
@@ -56,6 +47,7 @@ struct file_table_entry {
 	data_ptr buffer;
 	uint directory_start_cluster; // this is the cluster where the corresponding file entry for this file is
 				// if directory_start_cluster == 0: then, this file is in the root dir
+	int pinned_views; // number of views handed out by fs_read_view which point into buffer
 	struct dos_dir_entry directory_entry;
 };
 typedef struct file_table_entry* file_handle;
@@ -76,25 +68,15 @@ typedef struct file_table_entry* file_handle;
 #define GET_ONE_BYTE(ptr)   ((__u8 ) (*(__u8 *) (ptr)))
 
 // Global Definitions & Variables
-#define max(x, y) ((x) > (y) ? (x) : (y))
-#define min(x, y) ((x) < (y) ? (x) : (y))
-#define IS_DIRECTORY(entry)   ( ((entry) != NULL) && ((entry)->attr & FILE_ATTR_DIRECTORY) )
-#define IS_FILE(entry)        ( ((entry) != NULL) && !((entry)->attr & FILE_ATTR_DIRECTORY) )
-#define IS_EMPTY_ENTRY(entry) ( (*((data_ptr) (entry)) == 0xE5) )
-#define IS_LAST_CLUSTER(c)    ( (c) >= 0xFF7 )
-#define IS_ODD_NUMBER(n)      ( (n) & 0x1 )
-#define IS_VALID_ENTRY(e)     ( (e)->name[0] != 0x0 )
-#define HAS_LONG_FILENAME(e)  ( (e)->attr == 0x0F)
-#define LAST_CLUSTER		  0xFFF
 #define BIOS_READ_WRITE_SIZE  512 		// in bytes
 #define MAX_FILENAME_LENGTH    13  		// filename (8 bytes) + dot (1byte) + extension (3 bytes)
 #define MAX_PATH_LENGTH       255
 
-static int root_dir_start_sector = 0; 	// first sector of the root directory
-static int root_dir_sectors = 0;		// # of sectors reserved for root directory
-static int cluster_size = 0; 			// in bytes
-static int fat_size = 0; 				// in bytes
-static int number_of_clusters = 0;		// number of total clusters
+int root_dir_start_sector = 0; 	// first sector of the root directory
+int root_dir_sectors = 0;		// # of sectors reserved for root directory
+int cluster_size = 0; 			// in bytes
+int fat_size = 0; 				// in bytes
+int number_of_clusters = 0;		// number of total clusters
 
 
 /** Loads data of FAT{1,2,3...}.
@@ -103,7 +85,7 @@ static int number_of_clusters = 0;		// number of total clusters
  *  note: this function works for an arbitrarily number of FATs but
  *  our images have 2 in general.
  */
-static data_ptr load_fat(uint which) {
+data_ptr load_fat(uint which) {
 	assert(fbs.fats >= which); // FAT must exist
 
 	data_ptr fat = malloc(fat_size);
@@ -125,7 +107,7 @@ static data_ptr load_fat(uint which) {
  * @param which FAT to write to.
  * @param new_fat new FAT table data
  */
-static void write_fat(uint which, data_ptr new_fat) {
+void write_fat(uint which, data_ptr new_fat) {
 	assert(fbs.fats >= which); // FAT must exist
 
 	// determine which fat to write (FAT1 is at offset fbs.reserved)
@@ -143,7 +125,7 @@ static void write_fat(uint which, data_ptr new_fat) {
 /** This is just a helper function which writes new_fat in all existing FATs.
  *  @param new_fat data to write in all FATs.
  */
-static void write_all_fats(data_ptr new_fat) {
+void write_all_fats(data_ptr new_fat) {
 	int fat_nr;
 	for(fat_nr=1; fat_nr <= fbs.fats; fat_nr++)
 		write_fat(fat_nr, new_fat);
@@ -155,7 +137,7 @@ static void write_all_fats(data_ptr new_fat) {
  *  at least root_dir_sectors*fbs.sector_size bytes.
  *  @param buffer to store root dir in.
  */
-static void load_root_directory(data_ptr root_dir_data) {
+void load_root_directory(data_ptr root_dir_data) {
 
 	int i;
 	for(i=0; i<root_dir_sectors; i++) {
@@ -171,7 +153,7 @@ static void load_root_directory(data_ptr root_dir_data) {
 /** Saves the root directory to disk.
  * @param root_directory content of the root directory
  */
-static void write_root_directory(data_ptr root_directory) {
+void write_root_directory(data_ptr root_directory) {
 
 	int i;
 	for(i=0; i<root_dir_sectors; i++) {
@@ -189,7 +171,7 @@ static void write_root_directory(data_ptr root_directory) {
  *  @param number cluster to load
  *  @param buffer to write contents in
  */
-static void load_cluster(uint number, data_ptr buffer) {
+void load_cluster(uint number, data_ptr buffer) {
 
 	// internally we work with cluster numbers from 0 to n-2 to calculate the offset
 	number = number - 2;
@@ -207,7 +189,7 @@ static void load_cluster(uint number, data_ptr buffer) {
  *  @param number of the cluster
  *  @param buffer contains data to be written
  */
-static void write_cluster(uint number, data_ptr buffer) {
+void write_cluster(uint number, data_ptr buffer) {
 
 	number = number - 2; // internally we work with cluster numbers from 0 to n-2
 	int cluster_start_sector = (root_dir_start_sector + root_dir_sectors) + (number * fbs.sec_per_clus);
@@ -308,6 +290,7 @@ static file_handle create_file_handle(directory_entry_ptr entry, uint directory_
 
 	fh->pos = 0;
 	fh->buffer = NULL;
+	fh->pinned_views = 0;
 	fh->directory_start_cluster = directory_start_cluster;
 	memcpy(&fh->directory_entry, (data_ptr)entry, sizeof(struct dos_dir_entry));
 
@@ -340,6 +323,23 @@ static void convert_filename(const char* filename, char* fatname) {
 }
 
 
+/** Generates the name of a directory entry without the space padding,
+ *  "README  TXT" becomes "README.TXT" and "DIR     " becomes "DIR".
+ *  @param entry directory entry
+ *  @param name buffer of at least MAX_FILENAME_LENGTH bytes
+ */
+void format_entry_name(directory_entry_ptr entry, char* name) {
+	int name_len = 8, ext_len = 3;
+	while(name_len > 0 && entry->name[name_len-1] == ' ') name_len--;
+	while(ext_len > 0 && entry->ext[ext_len-1] == ' ') ext_len--;
+
+	if(ext_len > 0)
+		sprintf(name, "%.*s.%.*s", name_len, entry->name, ext_len, entry->ext);
+	else
+		sprintf(name, "%.*s", name_len, entry->name);
+}
+
+
 /** Finds the entry with name `entry_name` in the corresponding directory_data.
  * @param directory_data contents of the directory
  * @param entry_name name to search for
@@ -462,6 +462,8 @@ static void free_file_buffer(file_handle fh) {
 
 /** Closes a file. Frees resources in the file_table and the internal buffer.
  *	This function assumes that fd is a valid file descriptor.
+ *	As long as views of fs_read_view are pinned the buffer cannot be freed:
+ *	the file stays open then and an error is printed.
  *	@param fd file descriptor previously handed out to clients by fs_open.
  */
 void fs_close(int fd) {
@@ -469,6 +471,10 @@ void fs_close(int fd) {
 
 	if(file_table[fd] != NULL) {
 		file_handle fh = file_table[fd];
+		if(fh->pinned_views > 0) {
+			err("fs_close: views of the file are still pinned, it stays open\n");
+			return;
+		}
 
 		free_file_buffer(fh);
 
@@ -500,12 +506,24 @@ void fs_close(int fd) {
  *
  *  @param cluster_nr number of the current cluster
  */
-static int get_next_cluster_nr(int cluster_nr) {
+int get_next_cluster_nr(int cluster_nr) {
+	return get_fat_entry(FAT1, cluster_nr);
+}
+
+
+/** Reads the entry of `cluster_nr` out of an arbitrary FAT table.
+ *  This is what get_next_cluster_nr does for FAT1, but it allows
+ *  clients to look at the other FAT copies too (i.e. to compare them).
+ *  @param fat FAT table as returned by load_fat
+ *  @param cluster_nr number of the cluster
+ *  @return the 12 bit FAT entry of the cluster
+ */
+int get_fat_entry(data_ptr fat, int cluster_nr) {
 	assert(0 <= cluster_nr && cluster_nr <= number_of_clusters);
 
 	int fat_offset = cluster_nr + (cluster_nr / 2); // multiply by 1.5 [3 bytes per 2 cluster]
 
-	unsigned short next_cluster_nr = *(unsigned short*)&FAT1[fat_offset];
+	unsigned short next_cluster_nr = *(unsigned short*)&fat[fat_offset];
 
 	// this only works for little endian machines
 	if(IS_ODD_NUMBER(cluster_nr)) {
@@ -528,7 +546,7 @@ static int get_next_cluster_nr(int cluster_nr) {
  *  @param current cluster we want to set the next cluster for
  *  @param next cluster where current shall point to
  */
-static void set_next_cluster(int current, unsigned short next) {
+void set_next_cluster(int current, unsigned short next) {
 	assert(0 <= current && current <= number_of_clusters);
 
 	int fat_offset = current + (current / 2); // multiply by 1.5 [3 bytes per 2 cluster]
@@ -539,13 +557,25 @@ static void set_next_cluster(int current, unsigned short next) {
 	}
 	else {
 		FAT1[fat_offset] = next & 0xFF;
-		FAT1[fat_offset+1] =  (next & 0xF00) | (FAT1[fat_offset+1] & 0xF0); // preserve upper 4 bits
+		FAT1[fat_offset+1] =  ((next >> 8) & 0x0F) | (FAT1[fat_offset+1] & 0xF0); // preserve upper 4 bits
 	}
 
 	//DEBUG_PRINT("cluster %d next value set to: %d\n", current, get_next_cluster_nr(current));
 }
 
 
+/** Computes the number of clusters in the data region of the image.
+ *  Note: number_of_clusters also counts the sectors in front of the
+ *  data region, so it is an upper bound only. Valid data clusters are
+ *  FIRST_DATA_CLUSTER .. FIRST_DATA_CLUSTER+get_data_cluster_count()-1.
+ *  @return number of data clusters
+ */
+int get_data_cluster_count() {
+	int first_data_sector = root_dir_start_sector + root_dir_sectors;
+	return (fbs.sectors - first_data_sector) / fbs.sec_per_clus;
+}
+
+
 /** Walks through FAT and finds a free cluster.
  * @return the first cluster in the FAT which is found to be free - or
  * -1 if there are no more free clusters.
@@ -571,25 +601,31 @@ static int find_free_cluster() {
  *  If the buffer is non null then the function will free the buffer
  *  and replace it with the newly allocated one.
  *  Loading a file works by walking through the cluster chain
- *  using get_next_cluster. The buffer size is expanded as long as we
- *  have more clusters to load. Note that realloc with a null pointer
- *  is equivalent to calling malloc.
+ *  using get_next_cluster. We walk the chain twice: once to find out
+ *  how many clusters we need room for, and once to read the clusters
+ *  directly into their final place in the buffer (so there is no
+ *  intermediate copy and no realloc per cluster).
  *  @param file handle to load content for
  */
 static void load_file_contents(file_handle fh) {
 
 	free_file_buffer(fh);
 
-	// walk through the clusters, copy their contents into fh->buffer
+	int clusters = 0;
 	int current_cluster_nr = fh->directory_entry.start;
-	int i = 0;
-	while(!IS_LAST_CLUSTER(current_cluster_nr)) {
-		fh->buffer = realloc(fh->buffer, cluster_size*(i+1));
+	while(current_cluster_nr >= FIRST_DATA_CLUSTER && !IS_LAST_CLUSTER(current_cluster_nr)) {
+		clusters++;
+		current_cluster_nr = get_next_cluster_nr(current_cluster_nr);
+	}
 
-		data cluster_data[cluster_size];
-		load_cluster(current_cluster_nr, cluster_data);
-		memcpy(fh->buffer+(i++*cluster_size), cluster_data, cluster_size);
+	fh->buffer = malloc(max(clusters, 1)*cluster_size);
+	fh->buffer_size = clusters*cluster_size;
 
+	// walk through the clusters again, reading them into fh->buffer
+	current_cluster_nr = fh->directory_entry.start;
+	int i;
+	for(i=0; i<clusters; i++) {
+		load_cluster(current_cluster_nr, fh->buffer+(i*cluster_size));
 		current_cluster_nr = get_next_cluster_nr(current_cluster_nr);
 	}
 
@@ -726,6 +762,64 @@ int fs_read(int fd, void *buffer, int len) {
 }
 
 
+/** Hands out a read-only pointer to the next `len` bytes of a file
+ *  instead of copying them like fs_read does. The pointer points into
+ *  the file handle buffer, which holds the whole file in one contiguous
+ *  piece, so the view always covers all requested bytes up to the end of file.
+ *  At the end of file no view is handed out (`view` is set to NULL and nothing
+ *  has to be released). Otherwise the buffer stays pinned until the view is
+ *  returned with fs_release_view:
+ *  in the mean time fs_write on this file fails and fs_close leaves it open.
+ *	@param fd file descriptor identifying the file in the file_table
+ *	@param view is set to the beginning of the bytes read
+ *	@param len number of bytes to read
+ *	@return number of bytes covered by the view (can be less than `len` if
+ *			file size - current seek position is less than len) or -1 for
+ *			an invalid file descriptor
+ */
+int fs_read_view(int fd, const void **view, int len) {
+	assert(fd >= 0 && fd < MAX_FILES);
+
+	file_handle fh = file_table[fd];
+	if(fh != NULL) {
+
+		// lazy loading file contents on first read
+		if(fh->buffer == NULL)
+			load_file_contents(fh);
+
+		int bytes_to_read = min(len, fh->directory_entry.size - fh->pos);
+		if(bytes_to_read <= 0) {
+			*view = NULL; // EOF: nothing to pin
+			return 0;
+		}
+		*view = fh->buffer+fh->pos;
+
+		fh->pos += bytes_to_read;
+		fh->pinned_views++;
+
+		return bytes_to_read;
+	}
+
+	return -1; // invalid file descriptor
+}
+
+
+/** Gives back a view handed out by fs_read_view. The pointer must not be
+ *  used anymore after this call.
+ *	@param fd file descriptor the view was taken from
+ *	@param view pointer returned by fs_read_view
+ */
+void fs_release_view(int fd, const void *view) {
+	assert(fd >= 0 && fd < MAX_FILES);
+
+	file_handle fh = file_table[fd];
+	assert(fh != NULL && fh->pinned_views > 0);
+	assert((data_ptr)view >= fh->buffer && (data_ptr)view <= fh->buffer+fh->directory_entry.size);
+
+	fh->pinned_views--;
+}
+
+
 /** Creates a new directory_entry struct and initializes it with
  *  given values.
  *  @return the initialized struct
@@ -869,7 +963,8 @@ int fs_creat(const char *p)
  *  @param fd file descriptor
  *  @param buffer containing new content
  *  @param len size of the buffer
- *  @return the number of written bytes
+ *  @return the number of written bytes or -1 if the file is invalid or
+ *  views to its content are still pinned (see fs_read_view)
  *  note: as long as we have a valid file descriptor we always return len since we
  *  don't cover special cases where we're running out of clusters.
  */
@@ -878,6 +973,9 @@ int fs_write(int fd, void *buffer, int len) {
 	file_handle fh = file_table[fd];
 	if(fh != NULL) {
 
+		if(fh->pinned_views > 0)
+			return -1; // clients still read the old content in place
+
 		free_file_buffer(fh); // we don't need the old content anymore
 
 		fh->buffer = malloc(len); // reserve new internal buffer
@@ -893,3 +991,235 @@ int fs_write(int fd, void *buffer, int len) {
 	return -1;
 }
 
+
+/** Loads a whole directory into a newly allocated buffer: the root directory
+ *  for cluster 0, otherwise all clusters of the chain starting at `start_cluster`
+ *  (as in load_file_contents we walk the chain once to count the clusters).
+ *  One zeroed entry is appended, so the contents always end with an entry
+ *  which is not IS_VALID_ENTRY, even if the last cluster is full.
+ *  @param start_cluster first cluster of the directory, 0 for the root directory
+ *  @param entries is set to the number of entries in the directory clusters
+ *  @return the directory contents, clients have to free them
+ */
+static data_ptr load_directory_clusters(uint start_cluster, int *entries) {
+
+	data_ptr directory_data;
+	int size;
+
+	if(start_cluster == 0) {
+		size = root_dir_sectors*fbs.sector_size;
+		directory_data = malloc(size + sizeof(directory_entry));
+		load_root_directory(directory_data);
+	}
+	else {
+		int clusters = 0;
+		int current_cluster_nr = start_cluster;
+		while(current_cluster_nr >= FIRST_DATA_CLUSTER && !IS_LAST_CLUSTER(current_cluster_nr)
+		      && clusters < get_data_cluster_count()) { // a looping chain stops here
+			clusters++;
+			current_cluster_nr = get_next_cluster_nr(current_cluster_nr);
+		}
+
+		size = clusters*cluster_size;
+		directory_data = malloc(size + sizeof(directory_entry));
+
+		current_cluster_nr = start_cluster;
+		int i;
+		for(i=0; i<clusters; i++) {
+			load_cluster(current_cluster_nr, directory_data+(i*cluster_size));
+			current_cluster_nr = get_next_cluster_nr(current_cluster_nr);
+		}
+	}
+
+	memset(directory_data+size, 0, sizeof(directory_entry));
+	*entries = size / sizeof(directory_entry);
+	return directory_data;
+}
+
+
+/** Finds the ".." entry in the contents of a subdirectory. We cannot use
+ *  get_directory_entry for it: convert_filename takes the last dot as the
+ *  start of the extension, so ".." would match the "." entry.
+ *  @param directory_data contents of the directory
+ *  @param entries number of entries in directory_data
+ *  @return pointer to the ".." entry or NULL if there is none
+ */
+static directory_entry_ptr get_parent_directory_entry(data_ptr directory_data, int entries) {
+
+	directory_entry_ptr entry = (directory_entry_ptr) directory_data;
+	int i;
+	for(i=0; i<entries && IS_VALID_ENTRY(entry); i++, entry++) {
+		if(memcmp(entry->name, "..      ", 8) == 0 && IS_DIRECTORY(entry))
+			return entry;
+	}
+
+	return NULL;
+}
+
+
+/** Walks down the directory tree to the directory identified by `p`
+ *  and loads all its clusters (see load_directory_clusters).
+ *  "." stays in the current directory, ".." goes up using the ".." entry
+ *  (start cluster 0 means the root directory, where ".." stays too).
+ *  @param p path of the directory ("" or "/" for the root directory)
+ *  @param entries is set to the number of entries in the loaded directory
+ *  @return the directory contents (clients have to free them)
+ *  or NULL if p is not a directory
+ */
+static data_ptr load_directory(const char *p, int *entries) {
+
+	char path[MAX_PATH_LENGTH];
+	strcpy(path, p);
+
+	uint start_cluster = 0;
+	data_ptr directory_data = load_directory_clusters(start_cluster, entries);
+
+	char* current_name_token = strtok(path, "/");
+	while(current_name_token != NULL) {
+		boolean parent = (strcmp(current_name_token, "..") == 0);
+
+		if(strcmp(current_name_token, ".") != 0 && !(parent && start_cluster == 0)) {
+			directory_entry_ptr current_entry = parent
+				? get_parent_directory_entry(directory_data, *entries)
+				: get_directory_entry(directory_data, current_name_token);
+			if(!IS_DIRECTORY(current_entry)) {
+				free(directory_data);
+				return NULL; // file or nothing at all where we expect a directory
+			}
+
+			start_cluster = current_entry->start; // 0 for the root directory
+			free(directory_data);
+			directory_data = load_directory_clusters(start_cluster, entries);
+		}
+
+		current_name_token = strtok(NULL, "/");
+	}
+
+	return directory_data;
+}
+
+
+static int count_directory_tree(uint start_cluster);
+
+/** Appends the metadata of all children in `directory_data` to `stats`.
+ *  Deleted entries, long file name entries, volume labels and the
+ *  "." and ".." entries are skipped. Children which do not fit into
+ *  stats anymore are counted nevertheless, with `recursive` set
+ *  the trees below such directories are counted too.
+ *  @param directory_data contents of the directory
+ *  @param entries number of entries in directory_data
+ *  @param parent index of the directory in stats (-1 for the directory walked)
+ *  @param stats result array
+ *  @param count number of entries already in stats (or needed for them)
+ *  @param max_entries size of stats
+ *  @param recursive count the trees below the directories which do not fit
+ *  @return new number of entries needed in stats
+ */
+static int collect_directory_entries(data_ptr directory_data, int entries, int parent,
+                                     struct fs_stat *stats, int count, int max_entries,
+                                     boolean recursive) {
+
+	directory_entry_ptr entry = (directory_entry_ptr) directory_data;
+	int i;
+	for(i=0; i<entries && IS_VALID_ENTRY(entry); i++, entry++) {
+		if(!IS_CHILD_ENTRY(entry))
+			continue;
+
+		if(count >= max_entries) {
+			count++; // no room left: just count
+			if(recursive && IS_DIRECTORY(entry) && entry->start >= FIRST_DATA_CLUSTER)
+				count += count_directory_tree(entry->start);
+			continue;
+		}
+
+		struct fs_stat *st = &stats[count++];
+		format_entry_name(entry, st->name);
+		st->parent = parent;
+		st->attr   = entry->attr;
+		st->size   = entry->size;
+		st->start  = entry->start;
+		st->ctime  = entry->ctime;
+		st->cdate  = entry->cdate;
+		st->adate  = entry->adate;
+		st->time   = entry->time;
+		st->date   = entry->date;
+	}
+
+	return count;
+}
+
+
+/** Counts all files and directories below a directory, this is what
+ *  fs_walk needs for the parts of the tree which do not fit into stats.
+ *  @param start_cluster first cluster of the directory
+ *  @return number of entries in the tree (without the directory itself)
+ */
+static int count_directory_tree(uint start_cluster) {
+
+	int entries;
+	data_ptr directory_data = load_directory_clusters(start_cluster, &entries);
+	int count = collect_directory_entries(directory_data, entries, -1, NULL, 0, 0, TRUE);
+
+	free(directory_data);
+	return count;
+}
+
+
+/** Returns the metadata of all children of a directory in one go.
+ *  Compared to calling fs_open for every child this resolves the path
+ *  only once and does not allocate any file handles.
+ *  @param p path of the directory ("" or "/" for the root directory)
+ *  @param stats array to store the results in
+ *  @param max_entries size of the stats array
+ *  @return number of children of the directory, if this is more than
+ *  max_entries only the first max_entries are stored in stats,
+ *  or -1 if p is not a directory
+ */
+int fs_stat_dir(const char *p, struct fs_stat *stats, int max_entries) {
+
+	int entries;
+	data_ptr directory_data = load_directory(p, &entries);
+	if(directory_data == NULL)
+		return -1;
+
+	int count = collect_directory_entries(directory_data, entries, -1, stats, 0, max_entries, FALSE);
+
+	free(directory_data);
+	return count;
+}
+
+
+/** Returns the metadata of all files and directories below a directory.
+ *  The tree is walked breadth first and every directory is loaded exactly
+ *  once: the stats array doubles as our work queue, so when we reach a
+ *  directory entry in it we load its clusters and append its children.
+ *  The `parent` field of every result is the index of its directory in stats.
+ *  The trees below directories which do not fit into stats are only counted.
+ *  @param p path of the directory ("" or "/" for the root directory)
+ *  @param stats array to store the results in
+ *  @param max_entries size of the stats array
+ *  @return number of files and directories below p, if this is more than
+ *  max_entries only the first max_entries (in breadth first order) are
+ *  stored in stats, or -1 if p is not a directory
+ */
+int fs_walk(const char *p, struct fs_stat *stats, int max_entries) {
+
+	int entries;
+	data_ptr directory_data = load_directory(p, &entries);
+	if(directory_data == NULL)
+		return -1;
+
+	int count = collect_directory_entries(directory_data, entries, -1, stats, 0, max_entries, TRUE);
+	free(directory_data);
+
+	int i;
+	for(i=0; i<count && i<max_entries; i++) {
+		if((stats[i].attr & FILE_ATTR_DIRECTORY) && stats[i].start >= FIRST_DATA_CLUSTER) {
+			directory_data = load_directory_clusters(stats[i].start, &entries);
+			count = collect_directory_entries(directory_data, entries, i, stats, count, max_entries, TRUE);
+			free(directory_data);
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,77 @@
+/* FAT12 Driver internals
+ * ====================
+ * Types, geometry and cluster chain helpers of the FAT12 driver in
+ * fsdriver.c. They are shared with tools (like fsck) which work on
+ * the image below the level of file descriptors. All helpers operate
+ * on the in-memory copy of FAT1 which is loaded by fs_init, so fs_init
+ * has to be called before any of them is used.
+ *
+ * Authors
+ * ====================
+ * team07:
+ * Boris Bluntschli (borisb@student.ethz.ch)
+ * Gerd Zellweger (zgerd@student.ethz.ch)
+ *
+ */
+
+#ifndef __FSDRIVER_H_
+#define __FSDRIVER_H_
+
+#include "fs.h"
+
+// Some basic types & macros
+typedef int boolean;
+#define TRUE 1
+#define FALSE 0
+typedef unsigned int uint;
+typedef unsigned char data;
+typedef unsigned char* data_ptr;
+
+// Types needed for our FAT Implementation
+typedef struct dos_dir_entry  directory_entry;
+typedef struct dos_dir_entry* directory_entry_ptr;
+
+#define max(x, y) ((x) > (y) ? (x) : (y))
+#define min(x, y) ((x) < (y) ? (x) : (y))
+#define IS_DIRECTORY(entry)   ( ((entry) != NULL) && ((entry)->attr & FILE_ATTR_DIRECTORY) )
+#define IS_FILE(entry)        ( ((entry) != NULL) && !((entry)->attr & FILE_ATTR_DIRECTORY) )
+#define IS_EMPTY_ENTRY(entry) ( (*((data_ptr) (entry)) == 0xE5) )
+#define IS_LAST_CLUSTER(c)    ( (c) >= 0xFF7 )
+#define IS_ODD_NUMBER(n)      ( (n) & 0x1 )
+#define IS_VALID_ENTRY(e)     ( (e)->name[0] != 0x0 )
+#define HAS_LONG_FILENAME(e)  ( (e)->attr == 0x0F)
+#define IS_DOT_ENTRY(e)       ( (e)->name[0] == '.' ) 	// "." and ".." in subdirectories
+#define IS_CHILD_ENTRY(e)     ( !IS_EMPTY_ENTRY(e) && !HAS_LONG_FILENAME(e) && \
+                                !((e)->attr & FILE_ATTR_VOLUME) && !IS_DOT_ENTRY(e) )
+#define LAST_CLUSTER		  0xFFF
+#define BAD_CLUSTER           0xFF7
+#define FIRST_DATA_CLUSTER    2 		// cluster numbers 0 and 1 are reserved
+
+// Geometry of the mounted image, initialized by fs_init
+extern int root_dir_start_sector; 	// first sector of the root directory
+extern int root_dir_sectors;		// # of sectors reserved for root directory
+extern int cluster_size; 			// in bytes
+extern int fat_size; 				// in bytes
+extern int number_of_clusters;		// number of total clusters
+
+// FAT tables
+data_ptr load_fat(uint which);
+void write_fat(uint which, data_ptr new_fat);
+void write_all_fats(data_ptr new_fat);
+
+// Root directory and cluster I/O
+void load_root_directory(data_ptr root_dir_data);
+void write_root_directory(data_ptr root_directory);
+void load_cluster(uint number, data_ptr buffer);
+void write_cluster(uint number, data_ptr buffer);
+
+// Directory entries
+void format_entry_name(directory_entry_ptr entry, char* name);
+
+// Cluster chains (these work on FAT1)
+int get_next_cluster_nr(int cluster_nr);
+int get_fat_entry(data_ptr fat, int cluster_nr);
+void set_next_cluster(int current, unsigned short next);
+int get_data_cluster_count();
+
+#endif /* __FSDRIVER_H_ */
@@ -13,6 +13,11 @@
  */
 #define BUFFER_SIZE 512
 
+/** @def MAX_STATS
+ * maximum number of entries listed by the 'l' command
+ */
+#define MAX_STATS 1024
+
 /**
  * Prints an error on the test usage end exits
  */
@@ -37,11 +42,13 @@ int main(int argc, char **argv) {
   int     bytes         = 0;
   int     count         = 0;
   int     fds[10];
+  int     i             = 0;
   int     id            = 0;
   int     read_bytes    = 0;
   int     written_bytes = 0;
   size_t  len           = 0;
   ssize_t read          = 0;
+  struct fs_stat *stats = NULL;
 
   /* we should get one command line argument: *
    * the image file name                      */
@@ -144,6 +151,40 @@ int main(int argc, char **argv) {
 	count -= read_bytes;
       }
       break;
+    case 'v':
+      bytes = atoi(line);
+      printf("Viewing %i bytes from file %i\n", bytes, id);
+      count = bytes;
+      while (count > 0) {
+        const void *view;
+        read_bytes = fs_read_view(fds[id], &view, count);
+        if (read_bytes <= 0) {
+          // EOF
+          break;
+        }
+        printf("%.*s", read_bytes, (const char *)view);
+        fs_release_view(fds[id], view);
+        count -= read_bytes;
+      }
+      break;
+    case 'l':
+      printf("Listing tree %s\n", line);
+      stats = malloc(MAX_STATS * sizeof(struct fs_stat));
+      count = fs_walk(line, stats, MAX_STATS);
+      if (count == -1) {
+        fprintf(stderr, "Error: fs_walk(%s) failed!\n", line);
+        exit(EXIT_FAILURE);
+      }
+      for (i = 0; i < count && i < MAX_STATS; i++) {
+        printf("%3i %3i %-12s %c %8u %4u\n", i, stats[i].parent, stats[i].name,
+               (stats[i].attr & FILE_ATTR_DIRECTORY) ? 'd' : '-',
+               stats[i].size, stats[i].start);
+      }
+      if (count > MAX_STATS) {
+        printf("(%i more entries not listed)\n", count - MAX_STATS);
+      }
+      free(stats);
+      break;
     case 'w':
       len = strlen(line);
       printf("Writing %i bytes to file %i\n", (int)len , id);
@@ -53,9 +53,12 @@
 #define UTIL_WEIGHT .60
 
 /*
- * Alignment requirement in bytes (either 4 or 8)
+ * Alignment requirement in bytes (either 8 or 16). The Makefile passes
+ * the same value to the driver and mm.c with -DALIGNMENT.
  */
-#define ALIGNMENT 8
+#ifndef ALIGNMENT
+#define ALIGNMENT 16
+#endif
 
 /*
  * Maximum heap size in bytes
@@ -0,0 +1,228 @@
+/*
+ * heapviz.c - renders a heap timeline written by mdriver -H (see
+ *     timeline.h)
+ *
+ *	unix> mdriver -f traces/binary2-bal.rep -H binary2.tl -i 200
+ *	unix> heapviz -w 800 binary2.tl binary2.ppm
+ *
+ *     For every snapshot of the trace heapviz prints the free space:
+ *     KB used, pending, in unused parts of slabs and free, the
+ *     largest free block, the number of free blocks and the external
+ *     fragmentation (1 - largest/free). Given an output file it also
+ *     draws the fragmentation map as a PPM image: one row per snapshot
+ *     (top to bottom), the heap addresses from left to right, scaled to
+ *     the biggest heap of the trace. A pixel mixes the colors of the
+ *     bytes it covers: used red (slots too), pending yellow, unused slab
+ *     space blue, free green; bytes beyond the end of the heap (and list
+ *     heads) stay dark.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mm.h"
+#include "timeline.h"
+
+#define DEFAULT_WIDTH 512  /* pixels per row */
+#define MIN_HEIGHT 256     /* rows are repeated to get at least this height */
+
+/* colors of the block states (MM_BLOCK_*) and of the background */
+static const unsigned char colors[4][3] = {
+    {60, 190, 80},   /* MM_BLOCK_FREE */
+    {200, 60, 50},   /* MM_BLOCK_USED */
+    {70, 110, 220},  /* MM_BLOCK_SLAB */
+    {240, 200, 40},  /* MM_BLOCK_PENDING */
+};
+static const unsigned char background[3] = {30, 30, 30};
+
+/* a snapshot in the mapped timeline */
+typedef struct {
+    snapshot_header_t *header;
+    block_record_t *blocks;
+} snapshot_t;
+
+/*
+ * fail - prints an error message and exits
+ */
+static void fail(char *msg, char *path)
+{
+    fprintf(stderr, "heapviz: %s (%s)\n", msg, path);
+    exit(1);
+}
+
+/*
+ * print_series - prints the free space of one snapshot; pending blocks
+ *     are reported twice by mm_walk (as used and as pending)
+ */
+static void print_series(snapshot_t *snap)
+{
+    size_t bytes[4] = {0, 0, 0, 0};
+    size_t largest = 0, free_blocks = 0;
+    uint32_t i;
+
+    for (i = 0; i < snap->header->num_blocks; i++) {
+	block_record_t *r = &snap->blocks[i];
+	bytes[RECORD_STATE(r)] += RECORD_SIZE(r);
+	if (RECORD_STATE(r) == MM_BLOCK_FREE) {
+	    free_blocks++;
+	    if (RECORD_SIZE(r) > largest)
+		largest = RECORD_SIZE(r);
+	}
+    }
+    bytes[MM_BLOCK_USED] -= bytes[MM_BLOCK_PENDING];
+
+    printf("%8d%9.1f%9.1f%9.1f%9.1f%9.1f%9.1f%7lu%5.0f%%\n",
+	   snap->header->op,
+	   snap->header->heap_size / 1024.0,
+	   bytes[MM_BLOCK_USED] / 1024.0,
+	   bytes[MM_BLOCK_PENDING] / 1024.0,
+	   bytes[MM_BLOCK_SLAB] / 1024.0,
+	   bytes[MM_BLOCK_FREE] / 1024.0,
+	   largest / 1024.0,
+	   (unsigned long)free_blocks,
+	   bytes[MM_BLOCK_FREE] ?
+	   100.0 * (1.0 - (double)largest / bytes[MM_BLOCK_FREE]) : 0.0);
+}
+
+/*
+ * render_row - mixes the colors of the blocks of a snapshot into a row
+ *     of width pixels, each of them covers scale bytes of the heap
+ */
+static void render_row(snapshot_t *snap, int width, double scale,
+		       double (*bytes)[4], unsigned char *row)
+{
+    uint32_t i;
+    int x, s, c;
+
+    memset(bytes, 0, width * sizeof(*bytes));
+    for (i = 0; i < snap->header->num_blocks; i++) {
+	block_record_t *r = &snap->blocks[i];
+	double lo = r->offset / scale;
+	double hi = (r->offset + RECORD_SIZE(r)) / scale;
+	int state = RECORD_STATE(r);
+
+	for (x = (int)lo; x < width && x < hi; x++) {
+	    double part = (hi < x + 1 ? hi : x + 1) - (lo > x ? lo : x);
+	    bytes[x][state] += part;
+	    if (state == MM_BLOCK_PENDING) /* was reported as used before */
+		bytes[x][MM_BLOCK_USED] -= part;
+	}
+    }
+
+    for (x = 0; x < width; x++) {
+	double rest = 1.0;
+	for (s = 0; s < 4; s++)
+	    rest -= bytes[x][s];
+	if (rest < 0)
+	    rest = 0;
+	for (c = 0; c < 3; c++) {
+	    double v = rest * background[c];
+	    for (s = 0; s < 4; s++)
+		v += bytes[x][s] * colors[s][c];
+	    row[3*x + c] = v > 255 ? 255 : (unsigned char)v;
+	}
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int c, trace = -1, width = DEFAULT_WIDTH;
+    int i, n = 0, rows, repeat;
+    char *path, *map;
+    struct stat st;
+    size_t pos;
+    int fd;
+    snapshot_t *snaps = NULL;
+    uint32_t max_heap = 0;
+    unsigned char *row;
+    double (*bytes)[4];
+    FILE *out;
+
+    while ((c = getopt(argc, argv, "t:w:")) != EOF) {
+	switch (c) {
+	case 't': /* Number of the trace to render (default: the first one) */
+	    trace = atoi(optarg);
+	    break;
+	case 'w': /* Pixels per row */
+	    width = atoi(optarg);
+	    break;
+	default:
+	    optind = argc + 1;
+	}
+    }
+    if (width < 1 || optind >= argc || argc - optind > 2) {
+	fprintf(stderr, "Usage: heapviz [-t <trace>] [-w <width>] <timeline> [<map.ppm>]\n");
+	exit(1);
+    }
+    path = argv[optind];
+
+    /* map the timeline */
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+	fail("could not open timeline", path);
+    if (st.st_size < (off_t)sizeof(TIMELINE_MAGIC) - 1 ||
+	(map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED ||
+	memcmp(map, TIMELINE_MAGIC, sizeof(TIMELINE_MAGIC) - 1) != 0)
+	fail("not a heap timeline", path);
+    close(fd);
+
+    /* find the snapshots of the trace */
+    for (pos = sizeof(TIMELINE_MAGIC) - 1; pos < (size_t)st.st_size; ) {
+	snapshot_header_t *h = (snapshot_header_t *)(map + pos);
+
+	if (pos + sizeof(*h) > (size_t)st.st_size ||
+	    pos + sizeof(*h) + (size_t)h->num_blocks * sizeof(block_record_t) >
+	    (size_t)st.st_size)
+	    fail("truncated timeline", path);
+	if (trace < 0)
+	    trace = h->trace;
+	if (h->trace == trace) {
+	    if ((n & (n - 1)) == 0 &&
+		(snaps = realloc(snaps, (n ? 2 * n : 1) * sizeof(snapshot_t))) == NULL)
+		fail("out of memory", path);
+	    snaps[n].header = h;
+	    snaps[n].blocks = (block_record_t *)(h + 1);
+	    if (h->heap_size > max_heap)
+		max_heap = h->heap_size;
+	    n++;
+	}
+	pos += sizeof(*h) + (size_t)h->num_blocks * sizeof(block_record_t);
+    }
+    if (n == 0)
+	fail("no snapshots of this trace", path);
+
+    printf("Trace %d, %d snapshots (KB):\n", trace, n);
+    printf("%8s%9s%9s%9s%9s%9s%9s%7s%6s\n",
+	   "op", "heap", "used", "pending", "slab", "free", "largest", "blocks", "frag");
+    for (i = 0; i < n; i++)
+	print_series(&snaps[i]);
+
+    /* draw the fragmentation map */
+    if (argc - optind == 2) {
+	if ((out = fopen(argv[optind + 1], "wb")) == NULL)
+	    fail("could not open output", argv[optind + 1]);
+	repeat = (n < MIN_HEIGHT) ? (MIN_HEIGHT + n - 1) / n : 1;
+	rows = n * repeat;
+	if ((row = malloc(3 * width)) == NULL ||
+	    (bytes = malloc(width * sizeof(*bytes))) == NULL)
+	    fail("out of memory", path);
+
+	fprintf(out, "P6\n%d %d\n255\n", width, rows);
+	for (i = 0; i < n; i++) {
+	    render_row(&snaps[i], width, (double)max_heap / width, bytes, row);
+	    for (c = 0; c < repeat; c++)
+		fwrite(row, 3, width, out);
+	}
+	if (fclose(out) != 0)
+	    fail("could not write output", argv[optind + 1]);
+	free(row);
+	free(bytes);
+    }
+
+    free(snaps);
+    munmap(map, st.st_size);
+    return 0;
+}
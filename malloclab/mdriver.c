@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE     /* for tdestroy */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,11 +16,20 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <search.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "tracefmt.h"
+#include "timeline.h"
 
 /**********************
  * Constants and macros
@@ -31,17 +41,25 @@
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
+
+/* eval_mm_apis asks mm_memalign for 2*ALIGNMENT up to this many doublings */
+#define VALID_ALIGN_STEPS 6
+
+/* eval_mm_batch hands runs of up to this many requests to one batch call */
+#define BATCH_OPS 64
+
+/* ... and finally asks for this many bytes more than the heap holds */
+#define BATCH_OOM_SIZE (1 << 12)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
 /* Records the extent of each block's payload */
-typedef struct range_t {
+typedef struct {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
 } range_t;
 
 /* Characterizes a single trace operation (allocator request) */
@@ -51,6 +69,12 @@ typedef struct {
     int size;                         /* byte size of alloc/realloc request */
 } traceop_t;
 
+/* A binary trace is used in place, so its records must look like this */
+_Static_assert(sizeof(traceop_t) == sizeof(trace_record_t) &&
+	       ALLOC == TRACE_ALLOC && FREE == TRACE_FREE &&
+	       REALLOC == TRACE_REALLOC,
+	       "traceop_t doesn't match trace_record_t");
+
 /* Holds the information for one trace file*/
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
@@ -60,8 +84,81 @@ typedef struct {
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping of a binary trace, ops point into it */
+    size_t map_size;     /* byte size of the mapping */
 } trace_t;
 
+/*
+ * Latency histogram (HDR style): values below HIST_SUB ns have a bucket
+ * of their own, above that every power of two is split into HIST_SUB
+ * buckets, so a bucket is at most 1/HIST_SUB of its values wide.
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+typedef struct {
+    long count[HIST_BUCKETS]; /* number of values per bucket */
+    long n;                   /* number of values */
+    double sum;               /* sum of the values (for the mean) */
+    unsigned long max;        /* biggest value */
+} hist_t;
+
+/* Latency histograms of one trace: one per request type and all together */
+#define LAT_ALL 3
+#define LAT_TYPES 4
+static char *lat_names[LAT_TYPES] = {"malloc", "free", "realloc", "all"};
+
+/*
+ * Threaded replay (-T): the ids of a trace are partitioned across the
+ * threads, a thread does all requests of its ids in trace order. With
+ * PARTITION a thread frees its own blocks, with HANDOFF it hands them
+ * to the next thread which frees them (producer and consumer).
+ */
+#define PARTITION 0
+#define HANDOFF 1
+#define PATTERNS 2
+static char *pattern_names[PATTERNS] = {"partition", "handoff"};
+#define MAX_THREADS 64
+#define THREAD_COUNTS 8    /* 1, 2, 4, ... MAX_THREADS */
+#define REPLAY_RUNS 3      /* a threaded replay takes the best of these runs */
+#define INBOX_MAX 64       /* blocks waiting in an inbox before the producer waits */
+
+/*
+ * Heap timeline (-H): a snapshot of the heap layout (see timeline.h)
+ * every TIMELINE_INTERVAL requests unless -i says otherwise
+ */
+#define TIMELINE_INTERVAL 100
+
+/* Block records of one snapshot, filled in by mm_walk */
+typedef struct {
+    block_record_t *blocks;
+    uint32_t num_blocks;
+    uint32_t max_blocks;
+} snapshot_t;
+
+/* Blocks handed to a thread to free them (HANDOFF only) */
+typedef struct {
+    pthread_mutex_t lock;
+    char **blocks;         /* blocks[head..tail) are still to be freed */
+    int head, tail;
+} inbox_t;
+
+/* Parameters of one thread of a threaded replay */
+typedef struct {
+    trace_t *trace;
+    int *ops;              /* indices of the requests of this thread */
+    int num_ops;
+    int thread;            /* number of this thread */
+    int nthreads;
+    int pattern;           /* PARTITION or HANDOFF */
+    int libc;              /* use libc malloc instead of mm */
+    inbox_t *inboxes;      /* one per thread */
+    int *done;             /* number of threads done with their requests */
+    int check;             /* fill and verify the blocks (see replay_check) */
+    int bad_op;            /* first request whose block was wrong, -1 if none */
+    char *bad_msg;         /* ... and what was wrong with it */
+} replay_t;
+
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -69,7 +166,7 @@ typedef struct {
  */
 typedef struct {
     trace_t *trace;  
-    range_t *ranges;
+    void *ranges;
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
@@ -81,6 +178,22 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    size_t peak;     /* biggest footprint (heap and mapped bytes) in the util run */
+    size_t final;    /* footprint at the end of the util run */
+    hist_t *lat;     /* LAT_TYPES op latency histograms in ns (only with -L) */
+
+    /* defined only with -T: threaded replay times per pattern and thread count */
+    double thread_secs[PATTERNS][THREAD_COUNTS];
+
+    /* defined only with -S: mm_stats at the peak footprint and at the end */
+    mm_stats_t heap_peak;
+    mm_stats_t heap_end;
+
+    /* defined only with -A: replay with the blocks from an mm arena */
+    int arena_valid; /* were the blocks of the arena correct? */
+    int phases;      /* resets of the arena (and an unfinished last phase) */
+    double arena_util;
+    double arena_secs;
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -105,15 +218,16 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+/* these functions manipulate the range tree */
+static int add_range(void **ranges, char *lo, int size, 
 		     int tracenum, int opnum);
-static void remove_range(range_t **ranges, char *lo);
-static void clear_ranges(range_t **ranges);
+static void remove_range(void **ranges, char *lo);
+static void clear_ranges(void **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
 static void free_trace(trace_t *trace);
+static void map_trace(trace_t *trace, int fd, char *path);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -121,12 +235,37 @@ static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_valid(trace_t *trace, int tracenum, void **ranges);
+static int eval_mm_apis(trace_t *trace, int tracenum, void **ranges);
+static int eval_mm_batch(trace_t *trace, int tracenum, void **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, void **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static int replay_mm(trace_t *trace, int from, int to);
+static void eval_mm_heapstats(trace_t *trace, stats_t *stats);
+static void eval_mm_timeline(trace_t *trace, int tracenum, int interval,
+			     FILE *timeline);
+
+/* Replay of a trace with the blocks from an mm arena (-A) */
+static int replay_arena(trace_t *trace, int tracenum, void **ranges, 
+			int *max_total_size);
+static void eval_mm_arena(trace_t *trace, int tracenum, void **ranges, 
+			  stats_t *stats);
+static void eval_mm_arena_speed(void *ptr);
+
+/* Threaded replay of a trace with mm or libc malloc */
+static void eval_threads(trace_t *trace, int tracenum, int max_threads, 
+			 int libc, stats_t *stats);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printheapstats(int n, stats_t *stats);
+static void printarena(int n, stats_t *stats);
+static void writelatency(char *path, int json, char **tracefiles, 
+			 int n, stats_t *stats);
+static void printthreads(int n, int max_threads, stats_t *mm_stats, 
+			 stats_t *libc_stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -142,7 +281,7 @@ int main(int argc, char **argv)
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
+    void *ranges = NULL;       /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
@@ -150,6 +289,14 @@ int main(int argc, char **argv)
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int latency = 0;     /* If set, measure per-op latency of mm (set by -L) */
+    char *csvfile = NULL;  /* If set, write the latencies as CSV (-c) */
+    char *jsonfile = NULL; /* If set, write the latencies as JSON (-j) */
+    int threads = 0;     /* If set, replay with up to this many threads (-T) */
+    int heapstats = 0;   /* If set, print the statistics of mm (set by -S) */
+    FILE *timeline = NULL; /* If set, write heap snapshots to it (-H) */
+    int interval = TIMELINE_INTERVAL; /* requests between snapshots (-i) */
+    int arena = 0;       /* If set, replay with an mm arena too (set by -A) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +305,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:c:j:T:H:i:hvVgalLSA")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +331,42 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Measure the latency of every mm op */
+            latency = 1;
+            break;
+        case 'H': /* Write a timeline of heap snapshots */
+            if ((timeline = fopen(optarg, "wb")) == NULL)
+                unix_error("Could not open timeline file");
+            fwrite(TIMELINE_MAGIC, 1, sizeof(TIMELINE_MAGIC) - 1, timeline);
+            break;
+        case 'i': /* Requests between heap snapshots */
+            interval = atoi(optarg);
+            if (interval < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'S': /* Print the statistics of the mm package */
+            heapstats = 1;
+            break;
+        case 'A': /* Replay the traces with an mm arena too */
+            arena = 1;
+            break;
+        case 'T': /* Replay the traces with up to this many threads */
+            threads = atoi(optarg);
+            if (threads < 1 || threads > MAX_THREADS) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'c': /* Write the latencies to a CSV file */
+            csvfile = optarg;
+            latency = 1;
+            break;
+        case 'j': /* Write the latencies to a JSON file */
+            jsonfile = optarg;
+            latency = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -262,6 +445,8 @@ int main(int argc, char **argv)
 		if (verbose > 1)
 		    printf("and performance.\n");
 		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+		if (threads)
+		    eval_threads(trace, i, threads, 1, &libc_stats[i]);
 	    }
 	    free_trace(trace);
 	}
@@ -293,20 +478,37 @@ int main(int argc, char **argv)
 	mm_stats[i].ops = trace->num_ops;
 	if (verbose > 1)
 	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
+	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges) &&
+	    eval_mm_apis(trace, i, &ranges) &&
+	    eval_mm_batch(trace, i, &ranges);
 	if (mm_stats[i].valid) {
 	    if (verbose > 1)
 		printf("efficiency, ");
 	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    mm_stats[i].peak = mem_peak_footprint();
+	    mm_stats[i].final = mem_heapsize() + mem_mapsize();
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    if (latency)
+		eval_mm_latency(trace, &mm_stats[i]);
+	    if (heapstats)
+		eval_mm_heapstats(trace, &mm_stats[i]);
+	    if (timeline)
+		eval_mm_timeline(trace, i, interval, timeline);
+	    if (threads)
+		eval_threads(trace, i, threads, 0, &mm_stats[i]);
+	    if (arena)
+		eval_mm_arena(trace, i, &ranges, &mm_stats[i]);
 	}
 	free_trace(trace);
     }
 
+    if (timeline && fclose(timeline) != 0)
+	unix_error("Could not write timeline file");
+
     /* Display the mm results in a compact table */
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
@@ -314,6 +516,38 @@ int main(int argc, char **argv)
 	printf("\n");
     }
 
+    /* Display (and save) the per-op latencies */
+    if (latency) {
+	printf("\nLatency of mm malloc ops (ns):\n");
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+	if (csvfile)
+	    writelatency(csvfile, 0, tracefiles, num_tracefiles, mm_stats);
+	if (jsonfile)
+	    writelatency(jsonfile, 1, tracefiles, num_tracefiles, mm_stats);
+    }
+
+    /* Display the statistics of the allocator */
+    if (heapstats) {
+	printf("\nHeap of mm malloc at the peak footprint (KB, events over the whole trace):\n");
+	printheapstats(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Display the arena replays next to the normal ones */
+    if (arena) {
+	printf("\nArena replay (frees dropped, arena reset when no block is live):\n");
+	printarena(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Display the scaling of the threaded replays */
+    if (threads) {
+	printf("\nThreaded replay (ids of a trace partitioned across threads):\n");
+	printthreads(num_tracefiles, threads, mm_stats, libc_stats);
+	printf("\n");
+    }
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -367,22 +601,41 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. It is a
+ * tsearch(3) tree (balanced in glibc), so every request costs
+ * O(log n) in the number of allocated blocks.
  ****************************************************************/
 
+/*
+ * cmp_range - orders two payloads by address. The payloads in the tree
+ *     never overlap, so two ranges which do are "equal": looking a new
+ *     range up finds a payload it overlaps, if there is one.
+ */
+static int cmp_range(const void *a, const void *b)
+{
+    const range_t *p = a, *q = b;
+
+    if (p->hi < q->lo)
+	return -1;
+    if (p->lo > q->hi)
+	return 1;
+    return 0;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree.
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(void **ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, **node;
+    range_t key;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -395,71 +648,65 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
-	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
+    /* The payload must lie within the extent of the heap (or a region
+       the package mapped with mem_map) */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, hi)) {
+	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p) and mapped regions",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    key.lo = lo;
+    key.hi = hi;
+    if ((node = tfind(&key, ranges, cmp_range)) != NULL) {
+	p = *node;
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
 	unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    if (tsearch(p, ranges, cmp_range) == NULL)
+	unix_error("tsearch error in add_range");
     return 1;
 }
 
 /* 
  * remove_range - Free the range record of block whose payload starts at lo 
  */
-static void remove_range(range_t **ranges, char *lo)
+static void remove_range(void **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    range_t *p, **node;
+    range_t key;
+
+    key.lo = key.hi = lo;
+    if ((node = tfind(&key, ranges, cmp_range)) == NULL)
+	return;
+    p = *node;
+    if (p->lo == lo) {
+	tdelete(&key, ranges, cmp_range);
+	free(p);
     }
 }
 
 /*
  * clear_ranges - free all of the range records for a trace 
  */
-static void clear_ranges(range_t **ranges)
+static void clear_ranges(void **ranges)
 {
-    range_t *p;
-    range_t *pnext;
-
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    tdestroy(*ranges, free);
     *ranges = NULL;
 }
 
@@ -469,12 +716,16 @@ static void clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. A request
+ *    line may end with the number of the thread which made the request
+ *    (see tracecap.c), it is ignored. A binary trace (see tracefmt.h)
+ *    is mapped instead of read.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
     FILE *tracefile;
     trace_t *trace;
+    char line[MAXLINE];
     char type[MAXLINE];
     char path[MAXLINE];
     unsigned index, size;
@@ -495,6 +746,16 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
+    trace->map = NULL;
+    trace->map_size = 0;
+    if (fread(type, 1, sizeof(TRACE_MAGIC) - 1, tracefile) ==
+	sizeof(TRACE_MAGIC) - 1 &&
+	memcmp(type, TRACE_MAGIC, sizeof(TRACE_MAGIC) - 1) == 0) {
+	map_trace(trace, fileno(tracefile), path);
+	fclose(tracefile);
+	return trace;
+    }
+    rewind(tracefile);
     fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
     fscanf(tracefile, "%d", &(trace->num_ids));     
     fscanf(tracefile, "%d", &(trace->num_ops));     
@@ -518,24 +779,26 @@ static trace_t *read_trace(char *tracedir, char *filename)
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
+    while (fgets(line, MAXLINE, tracefile) != NULL) {
+	if (sscanf(line, "%s", type) != 1)
+	    continue; /* empty line (or the end of the header) */
 	switch(type[0]) {
 	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
+	    sscanf(line, "%*s %u %u", &index, &size);
 	    trace->ops[op_index].type = ALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
+	    sscanf(line, "%*s %u %u", &index, &size);
 	    trace->ops[op_index].type = REALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'f':
-	    fscanf(tracefile, "%ud", &index);
+	    sscanf(line, "%*s %u", &index);
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
 	    break;
@@ -554,13 +817,71 @@ static trace_t *read_trace(char *tracedir, char *filename)
     return trace;
 }
 
+/*
+ * map_trace - map the binary trace open on fd and point trace->ops at
+ *     its records. The records are checked once so that the evaluation
+ *     loops can trust them, but nothing is copied or converted.
+ */
+static void map_trace(trace_t *trace, int fd, char *path)
+{
+    trace_header_t *header;
+    traceop_t *ops;
+    struct stat st;
+    int i;
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(trace_header_t)) {
+	sprintf(msg, "Could not stat %s in map_trace", path);
+	unix_error(msg);
+    }
+    trace->map_size = st.st_size;
+    trace->map = mmap(NULL, trace->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->map == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in map_trace", path);
+	unix_error(msg);
+    }
+
+    header = (trace_header_t *)trace->map;
+    trace->sugg_heapsize = header->sugg_heapsize;
+    trace->num_ids = header->num_ids;
+    trace->num_ops = header->num_ops;
+    trace->weight = header->weight;
+    if (trace->num_ids < 0 || trace->num_ops < 0 ||
+	trace->map_size != sizeof(trace_header_t) +
+	(size_t)trace->num_ops * sizeof(trace_record_t)) {
+	printf("Bad header in binary tracefile %s\n", path);
+	exit(1);
+    }
+
+    ops = (traceop_t *)((char *)trace->map + sizeof(trace_header_t));
+    for (i = 0; i < trace->num_ops; i++) {
+	if ((unsigned)ops[i].type > REALLOC ||
+	    (unsigned)ops[i].index >= (unsigned)trace->num_ids ||
+	    ops[i].size < 0) {
+	    printf("Bad request %d in binary tracefile %s\n", i, path);
+	    exit(1);
+	}
+    }
+    trace->ops = ops;
+
+    if ((trace->blocks =
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 3 failed in map_trace");
+    if ((trace->block_sizes =
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 4 failed in map_trace");
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace(). The
+ *              requests of a binary trace are unmapped instead.
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map != NULL)   /* free the three arrays... */
+	munmap(trace->map, trace->map_size);
+    else
+	free(trace->ops);
     free(trace->blocks);      
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
@@ -574,7 +895,7 @@ void free_trace(trace_t *trace)
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static int eval_mm_valid(trace_t *trace, int tracenum, void **ranges) 
 {
     int i, j;
     int index;
@@ -584,7 +905,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     char *oldp;
     char *p;
     
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
 
@@ -611,7 +932,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
@@ -638,10 +959,10 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
 	    
@@ -668,7 +989,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case FREE: /* mm_free */
 	    
-	    /* Remove region from list and call student's free function */
+	    /* Remove region from tree and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
 	    mm_free(p);
@@ -684,18 +1005,273 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     return 1;
 }
 
+/*
+ * eval_mm_apis - Check mm_calloc, mm_memalign and mm_free_sized: the
+ *     trace is replayed like in eval_mm_valid, but every third block
+ *     comes from mm_calloc (which has to clear it) and every third from
+ *     mm_memalign (with alignments from 2*ALIGNMENT up), the rest from
+ *     mm_malloc. Every block is freed with mm_free_sized.
+ */
+static int eval_mm_apis(trace_t *trace, int tracenum, void **ranges)
+{
+    int i, j;
+    int index;
+    int size;
+    int oldsize;
+    size_t align;
+    char *newp;
+    char *p;
+
+    /* Reset the heap and free any records in the range tree */
+    mem_reset_brk();
+    clear_ranges(ranges);
+
+    if (mm_init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	return 0;
+    }
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_calloc, mm_memalign or mm_malloc */
+	    align = 0;
+	    switch (i % 3) {
+	    case 0:
+		p = mm_calloc(1, size);
+		break;
+	    case 1:
+		align = (size_t)2 * ALIGNMENT << ((i / 3) % VALID_ALIGN_STEPS);
+		p = mm_memalign(align, size);
+		break;
+	    default:
+		p = mm_malloc(size);
+	    }
+	    if (p == NULL) {
+		malloc_error(tracenum, i, "mm_calloc, mm_memalign or "
+			     "mm_malloc failed.");
+		return 0;
+	    }
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+
+	    /* A block of mm_calloc must be zero, one of mm_memalign aligned */
+	    if (i % 3 == 0) {
+		for (j = 0; j < size; j++) {
+		    if (p[j] != 0) {
+			malloc_error(tracenum, i, "mm_calloc did not clear the block");
+			return 0;
+		    }
+		}
+	    }
+	    if (align != 0 && (uintptr_t)p % align != 0) {
+		malloc_error(tracenum, i, "mm_memalign returned a misaligned block");
+		return 0;
+	    }
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case REALLOC: /* mm_realloc, as in eval_mm_valid */
+	    p = trace->blocks[index];
+	    if ((newp = mm_realloc(p, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_realloc failed.");
+		return 0;
+	    }
+	    remove_range(ranges, p);
+	    if (add_range(ranges, newp, size, tracenum, i) == 0)
+		return 0;
+	    oldsize = trace->block_sizes[index];
+	    if (size < oldsize) oldsize = size;
+	    for (j = 0; j < oldsize; j++) {
+		if (newp[j] != (char)(index & 0xFF)) {
+		    malloc_error(tracenum, i, "mm_realloc did not preserve the "
+				 "data from old block");
+		    return 0;
+		}
+	    }
+	    memset(newp, index & 0xFF, size);
+	    trace->blocks[index] = newp;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE: /* mm_free_sized */
+	    p = trace->blocks[index];
+	    remove_range(ranges, p);
+	    mm_free_sized(p, trace->block_sizes[index]);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_apis");
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * eval_mm_batch - Check mm_malloc_batch and mm_free_batch: a run of
+ *     allocations of the same size is one mm_malloc_batch, a run of
+ *     frees one mm_free_batch. The blocks are checked like in
+ *     eval_mm_valid and must still hold their pattern when they are
+ *     freed. At the end a batch bigger than the heap must come back
+ *     partial, with every block it did return usable.
+ */
+static int eval_mm_batch(trace_t *trace, int tracenum, void **ranges)
+{
+    int i, j, k, n;
+    int index;
+    int size;
+    int oldsize;
+    size_t got;
+    char *newp;
+    char *p;
+    void *ptrs[BATCH_OPS];
+    void **oom;
+
+    /* Reset the heap and free any records in the range tree */
+    mem_reset_brk();
+    clear_ranges(ranges);
+
+    if (mm_init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	return 0;
+    }
+
+    for (i = 0;  i < trace->num_ops;  i += n) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc_batch for the run of this size */
+	    for (n = 1; n < BATCH_OPS && i + n < trace->num_ops &&
+		     trace->ops[i+n].type == ALLOC &&
+		     trace->ops[i+n].size == size; n++)
+		;
+	    if (mm_malloc_batch(size, n, ptrs) != (size_t)n) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+	    for (j = 0; j < n; j++) {
+		index = trace->ops[i+j].index;
+		p = ptrs[j];
+		if (add_range(ranges, p, size, tracenum, i + j) == 0)
+		    return 0;
+		memset(p, index & 0xFF, size);
+		trace->blocks[index] = p;
+		trace->block_sizes[index] = size;
+	    }
+	    break;
+
+        case REALLOC: /* mm_realloc, as in eval_mm_valid */
+	    n = 1;
+	    p = trace->blocks[index];
+	    if ((newp = mm_realloc(p, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_realloc failed.");
+		return 0;
+	    }
+	    remove_range(ranges, p);
+	    if (add_range(ranges, newp, size, tracenum, i) == 0)
+		return 0;
+	    oldsize = trace->block_sizes[index];
+	    if (size < oldsize) oldsize = size;
+	    for (j = 0; j < oldsize; j++) {
+		if (newp[j] != (char)(index & 0xFF)) {
+		    malloc_error(tracenum, i, "mm_realloc did not preserve the "
+				 "data from old block");
+		    return 0;
+		}
+	    }
+	    memset(newp, index & 0xFF, size);
+	    trace->blocks[index] = newp;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case FREE: /* mm_free_batch for the run of frees */
+	    for (n = 1; n < BATCH_OPS && i + n < trace->num_ops &&
+		     trace->ops[i+n].type == FREE; n++)
+		;
+	    for (j = 0; j < n; j++) {
+		index = trace->ops[i+j].index;
+		p = trace->blocks[index];
+		for (k = 0; k < (int)trace->block_sizes[index]; k++) {
+		    if (p[k] != (char)(index & 0xFF)) {
+			malloc_error(tracenum, i + j, "Payload of a block was "
+				     "overwritten before mm_free_batch");
+			return 0;
+		    }
+		}
+		remove_range(ranges, p);
+		ptrs[j] = p;
+	    }
+	    mm_free_batch(ptrs, n);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_batch");
+        }
+    }
+
+    /* 
+     * A batch which does not fit into the heap returns the blocks
+     * there is space for, they must be as good as the others
+     */
+    n = MAX_HEAP / BATCH_OOM_SIZE + 1;
+    if ((oom = malloc(n * sizeof(void *))) == NULL)
+	unix_error("malloc failed in eval_mm_batch");
+    mem_set_quiet(1);
+    got = mm_malloc_batch(BATCH_OOM_SIZE, n, oom);
+    mem_set_quiet(0);
+    if (got >= (size_t)n) {
+	malloc_error(tracenum, trace->num_ops, 
+		     "mm_malloc_batch returned more than the heap holds");
+	free(oom);
+	return 0;
+    }
+    for (j = 0; j < (int)got; j++) {
+	if (add_range(ranges, oom[j], BATCH_OOM_SIZE, tracenum, 
+		      trace->num_ops) == 0) {
+	    free(oom);
+	    return 0;
+	}
+	memset(oom[j], j & 0xFF, BATCH_OOM_SIZE);
+    }
+    for (j = 0; j < (int)got; j++) {
+	p = oom[j];
+	for (k = 0; k < BATCH_OOM_SIZE; k++) {
+	    if (p[k] != (char)(j & 0xFF)) {
+		malloc_error(tracenum, trace->num_ops, "Payload of a block of "
+			     "a partial mm_malloc_batch was overwritten");
+		free(oom);
+		return 0;
+	    }
+	}
+	remove_range(ranges, p);
+    }
+    mm_free_batch(oom, got);
+    free(oom);
+
+    return 1;
+}
+
 /* 
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   biggest footprint in bytes (size of the heap plus the regions
+ *   mapped with mem_map()) while running the student's malloc package
+ *   on the trace. The heap can shrink (mem_sbrk() takes negative
+ *   increments), so this is the peak reported by mem_peak_footprint()
+ *   and not the final footprint.
  *   
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, void **ranges)
 {   
     int i;
     int index;
@@ -774,7 +1350,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_footprint());
 }
 
 
@@ -825,6 +1401,607 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * hist_add - adds a value to a latency histogram
+ */
+static void hist_add(hist_t *h, unsigned long v)
+{
+    int msb, bucket;
+
+    if (v < HIST_SUB) {
+	bucket = v;
+    } else {
+	msb = 63 - __builtin_clzl(v);
+	bucket = (msb - HIST_SUB_BITS + 1) * HIST_SUB + 
+	    ((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    }
+    h->count[bucket]++;
+    h->n++;
+    h->sum += v;
+    if (v > h->max)
+	h->max = v;
+}
+
+/*
+ * hist_percentile - returns the value below or at which a fraction q
+ *    of the values of a histogram are (the biggest value of its bucket)
+ */
+static unsigned long hist_percentile(hist_t *h, double q)
+{
+    long rank = (long)(q * h->n), seen = 0;
+    int i, shift;
+    unsigned long hi;
+
+    if (rank < q * h->n)
+	rank++;
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += h->count[i];
+	if (seen >= rank)
+	    break;
+    }
+    if (i < HIST_SUB) {
+	hi = i;
+    } else {
+	shift = i / HIST_SUB - 1;
+	hi = ((unsigned long)(HIST_SUB + i % HIST_SUB) << shift) + 
+	    ((1UL << shift) - 1);
+    }
+    return hi < h->max ? hi : h->max;
+}
+
+/*
+ * eval_mm_latency - Runs the trace once more and times every single
+ *    mm_malloc, mm_realloc and mm_free call on its own with
+ *    clock_gettime. The average of eval_mm_speed hides the slow calls,
+ *    the histograms of the latencies show them.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    int i, index;
+    char *p = NULL;
+    struct timespec start, end;
+    unsigned long ns;
+
+    if (stats->lat == NULL &&
+	(stats->lat = (hist_t *)calloc(LAT_TYPES, sizeof(hist_t))) == NULL)
+	unix_error("calloc failed in eval_mm_latency");
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	switch (trace->ops[i].type) {
+	case ALLOC: /* mm_malloc */
+	    p = mm_malloc(trace->ops[i].size);
+	    break;
+	case REALLOC: /* mm_realloc */
+	    p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+	    break;
+	case FREE: /* mm_free */
+	    mm_free(trace->blocks[index]);
+	    break;
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (trace->ops[i].type != FREE) {
+	    if (p == NULL)
+		app_error("mm_malloc or mm_realloc failed in eval_mm_latency");
+	    trace->blocks[index] = p;
+	}
+	ns = (end.tv_sec - start.tv_sec) * 1000000000UL + end.tv_nsec - start.tv_nsec;
+	hist_add(&stats->lat[trace->ops[i].type], ns);
+	hist_add(&stats->lat[LAT_ALL], ns);
+    }
+}
+
+/*
+ * replay_mm - runs requests from ... to-1 of the trace with the mm
+ *    package and returns the last request which raised the peak
+ *    footprint (from-1 if none did)
+ */
+static int replay_mm(trace_t *trace, int from, int to)
+{
+    int i, index, peak_op = from - 1;
+    size_t peak = mem_peak_footprint();
+    char *p = NULL;
+
+    for (i = from;  i < to;  i++) {
+	index = trace->ops[i].index;
+	switch (trace->ops[i].type) {
+	case ALLOC: /* mm_malloc */
+	    p = mm_malloc(trace->ops[i].size);
+	    break;
+	case REALLOC: /* mm_realloc */
+	    p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+	    break;
+	case FREE: /* mm_free */
+	    mm_free(trace->blocks[index]);
+	    break;
+	default:
+	    app_error("Nonexistent request type in replay_mm");
+	}
+	if (trace->ops[i].type != FREE) {
+	    if (p == NULL)
+		app_error("mm_malloc or mm_realloc failed in replay_mm");
+	    trace->blocks[index] = p;
+	}
+	if (mem_peak_footprint() > peak) {
+	    peak = mem_peak_footprint();
+	    peak_op = i;
+	}
+    }
+    return peak_op;
+}
+
+/*
+ * eval_mm_heapstats - gets mm_stats of the mm package when the trace
+ *    reaches its peak footprint (which decides the utilization) and at
+ *    the end. The package is deterministic, so a first replay finds
+ *    the request of the peak and a second one stops after it.
+ */
+static void eval_mm_heapstats(trace_t *trace, stats_t *stats)
+{
+    int peak_op;
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_heapstats");
+    peak_op = replay_mm(trace, 0, trace->num_ops);
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_heapstats");
+    replay_mm(trace, 0, peak_op + 1);
+    mm_stats(&stats->heap_peak);
+    replay_mm(trace, peak_op + 1, trace->num_ops);
+    mm_stats(&stats->heap_end);
+}
+
+/*
+ * snapshot_block - mm_walk callback, adds a block record to a snapshot
+ */
+static void snapshot_block(void *arg, void *start, size_t size, int state)
+{
+    snapshot_t *snap = arg;
+    block_record_t *r;
+
+    if (snap->num_blocks == snap->max_blocks) {
+	snap->max_blocks = snap->max_blocks ? 2 * snap->max_blocks : 1024;
+	if ((snap->blocks = realloc(snap->blocks, 
+				    snap->max_blocks * sizeof(block_record_t))) == NULL)
+	    unix_error("realloc failed in snapshot_block");
+    }
+    r = &snap->blocks[snap->num_blocks++];
+    r->offset = (char *)start - (char *)mem_heap_lo();
+    r->size_state = size | state;
+}
+
+/*
+ * eval_mm_timeline - replays the trace with the mm package and writes a
+ *    snapshot of the heap to the timeline at the start and after every
+ *    interval requests
+ */
+static void eval_mm_timeline(trace_t *trace, int tracenum, int interval,
+			     FILE *timeline)
+{
+    snapshot_t snap = {NULL, 0, 0};
+    snapshot_header_t header;
+    int i = 0, next;
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_timeline");
+
+    for (;;) {
+	snap.num_blocks = 0;
+	mm_walk(snapshot_block, &snap);
+	header.trace = tracenum;
+	header.op = i;
+	header.heap_size = mem_heapsize();
+	header.num_blocks = snap.num_blocks;
+	fwrite(&header, sizeof(header), 1, timeline);
+	fwrite(snap.blocks, sizeof(block_record_t), snap.num_blocks, timeline);
+
+	if (i == trace->num_ops)
+	    break;
+	next = (trace->num_ops - i > interval) ? i + interval : trace->num_ops;
+	replay_mm(trace, i, next);
+	i = next;
+    }
+    free(snap.blocks);
+}
+
+/*
+ * replay_arena - replays a trace with the blocks from an mm arena (-A):
+ *    frees are dropped, a realloc is a new block and a copy, and the
+ *    arena is reset whenever no block of the trace is live, which ends
+ *    a phase. With ranges the blocks are checked like in eval_mm_valid.
+ *    Returns the number of phases, -1 if a check failed and -2 if the
+ *    arena ran out of memory (traces whose blocks are never all freed
+ *    at once are no use for an arena); *max_total_size gets the most
+ *    payload bytes live at once.
+ */
+static int replay_arena(trace_t *trace, int tracenum, void **ranges, 
+			int *max_total_size)
+{
+    int i, j, index, size, oldsize;
+    int live = 0, phases = 0, total_size = 0, ret = 0;
+    mm_arena_t *arena;
+    char *p, *oldp;
+
+    *max_total_size = 0;
+    if ((arena = mm_arena_create(0)) == NULL)
+	return -2;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+	switch (trace->ops[i].type) {
+	case ALLOC: /* mm_arena_alloc */
+	case REALLOC: /* mm_arena_alloc and a copy */
+	    if ((p = mm_arena_alloc(arena, size)) == NULL) {
+		ret = -2;
+		goto out;
+	    }
+	    oldsize = 0;
+	    if (trace->ops[i].type == REALLOC) {
+		oldp = trace->blocks[index];
+		oldsize = trace->block_sizes[index];
+		if (size < oldsize)
+		    oldsize = size;
+		memcpy(p, oldp, oldsize);
+		if (ranges)
+		    remove_range(ranges, oldp);
+		total_size -= trace->block_sizes[index];
+	    } else
+		live++;
+
+	    if (ranges) {
+		if (add_range(ranges, p, size, tracenum, i) == 0) {
+		    ret = -1;
+		    goto out;
+		}
+		for (j = 0; j < oldsize; j++) {
+		    if (p[j] != (char)(index & 0xFF)) {
+			malloc_error(tracenum, i, "arena realloc did not preserve "
+				     "the data from old block");
+			ret = -1;
+			goto out;
+		    }
+		}
+		memset(p, index & 0xFF, size);
+	    }
+
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    if (total_size > *max_total_size)
+		*max_total_size = total_size;
+	    break;
+
+	case FREE: /* dropped, the end of a phase resets the arena */
+	    if (ranges)
+		remove_range(ranges, trace->blocks[index]);
+	    total_size -= trace->block_sizes[index];
+	    if (--live == 0) {
+		mm_arena_reset(arena);
+		phases++;
+	    }
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in replay_arena");
+	}
+    }
+
+    ret = (live > 0) ? phases + 1 : phases;
+ out: /* every exit destroys the arena */
+    mm_arena_destroy(arena);
+    return ret;
+}
+
+/*
+ * eval_mm_arena - checks the arena replay of a trace, then measures its
+ *    utilization (like eval_mm_util) and its speed
+ */
+static void eval_mm_arena(trace_t *trace, int tracenum, void **ranges, 
+			  stats_t *stats)
+{
+    speed_t speed_params;
+    int max_total_size;
+
+    mem_reset_brk();
+    clear_ranges(ranges);
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_arena");
+
+    stats->phases = replay_arena(trace, tracenum, ranges, &max_total_size);
+    stats->arena_valid = (stats->phases >= 0);
+    if (!stats->arena_valid)
+	return;
+    stats->arena_util = (double)max_total_size / (double)mem_peak_footprint();
+
+    speed_params.trace = trace;
+    speed_params.ranges = NULL;
+    stats->arena_secs = fsecs(eval_mm_arena_speed, &speed_params);
+}
+
+/*
+ * eval_mm_arena_speed - the arena replay without the checks, timed by fcyc()
+ */
+static void eval_mm_arena_speed(void *ptr)
+{
+    int max_total_size;
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_arena_speed");
+    if (replay_arena(((speed_t *)ptr)->trace, 0, NULL, &max_total_size) < 0)
+	app_error("mm_arena_alloc failed in eval_mm_arena_speed");
+}
+
+/*
+ * replay_free - frees a block with mm or libc free
+ */
+static void replay_free(replay_t *r, char *p)
+{
+    if (r->libc)
+	free(p);
+    else
+	mm_free(p);
+}
+
+/*
+ * replay_drain - frees the blocks other threads have handed to this one
+ */
+static void replay_drain(replay_t *r)
+{
+    inbox_t *in = &r->inboxes[r->thread];
+    int head, tail;
+
+    pthread_mutex_lock(&in->lock);
+    head = in->head;
+    tail = in->tail;
+    in->head = tail;
+    pthread_mutex_unlock(&in->lock);
+
+    /* nobody writes blocks[head..tail) anymore */
+    for (; head < tail; head++)
+	replay_free(r, in->blocks[head]);
+}
+
+/*
+ * replay_check - a checked replay fills every block with the low byte
+ *     of its id (like eval_mm_valid), this makes sure that the first len
+ *     bytes of the block still hold it. The first request of the thread
+ *     with a wrong block is remembered for eval_threads.
+ */
+static void replay_check(replay_t *r, int op, char *p, int index, int len, 
+			 char *msg)
+{
+    int j;
+
+    for (j = 0; j < len; j++) {
+	if (p[j] != (char)(index & 0xFF)) {
+	    if (r->bad_op < 0) {
+		r->bad_op = op;
+		r->bad_msg = msg;
+	    }
+	    return;
+	}
+    }
+}
+
+/*
+ * replay_thread - does the requests of one thread of a threaded replay
+ */
+static void *replay_thread(void *ptr)
+{
+    replay_t *r = (replay_t *)ptr;
+    trace_t *trace = r->trace;
+    inbox_t *next = &r->inboxes[(r->thread + 1) % r->nthreads];
+    int i, index, size, oldsize, done;
+    char *p;
+
+    for (i = 0; i < r->num_ops; i++) {
+	index = trace->ops[r->ops[i]].index;
+	size = trace->ops[r->ops[i]].size;
+	switch (trace->ops[r->ops[i]].type) {
+	case ALLOC: /* malloc */
+	    p = r->libc ? malloc(size) : mm_malloc(size);
+	    if (p == NULL)
+		app_error("malloc failed in replay_thread");
+	    if (r->check) {
+		if (!IS_ALIGNED(p) && r->bad_op < 0) {
+		    r->bad_op = r->ops[i];
+		    r->bad_msg = "mm_malloc returned a misaligned block";
+		}
+		memset(p, index & 0xFF, size);
+		trace->block_sizes[index] = size;
+	    }
+	    trace->blocks[index] = p;
+	    break;
+	case REALLOC: /* realloc */
+	    p = trace->blocks[index];
+	    p = r->libc ? realloc(p, size) : mm_realloc(p, size);
+	    if (p == NULL)
+		app_error("realloc failed in replay_thread");
+	    if (r->check) {
+		oldsize = trace->block_sizes[index];
+		replay_check(r, r->ops[i], p, index, 
+			     size < oldsize ? size : oldsize, 
+			     "mm_realloc did not preserve the data from old block");
+		memset(p, index & 0xFF, size);
+		trace->block_sizes[index] = size;
+	    }
+	    trace->blocks[index] = p;
+	    break;
+	case FREE: /* free, or hand it to the next thread */
+	    if (r->check)
+		replay_check(r, r->ops[i], trace->blocks[index], index, 
+			     trace->block_sizes[index],
+			     "Payload of a block was overwritten before it was freed");
+	    if (r->pattern == HANDOFF) {
+		/* don't run away from the consumer, the heap would grow */
+		pthread_mutex_lock(&next->lock);
+		while (next->tail - next->head >= INBOX_MAX) {
+		    pthread_mutex_unlock(&next->lock);
+		    replay_drain(r);
+		    sched_yield();
+		    pthread_mutex_lock(&next->lock);
+		}
+		next->blocks[next->tail++] = trace->blocks[index];
+		pthread_mutex_unlock(&next->lock);
+	    } else {
+		replay_free(r, trace->blocks[index]);
+	    }
+	    break;
+	default:
+	    app_error("Nonexistent request type in replay_thread");
+	}
+	if (r->pattern == HANDOFF)
+	    replay_drain(r);
+    }
+
+    /* a consumer has to wait for the blocks of its producer */
+    if (r->pattern == HANDOFF) {
+	pthread_mutex_lock(&r->inboxes[0].lock);
+	(*r->done)++;
+	pthread_mutex_unlock(&r->inboxes[0].lock);
+	do {
+	    pthread_mutex_lock(&r->inboxes[0].lock);
+	    done = (*r->done == r->nthreads);
+	    pthread_mutex_unlock(&r->inboxes[0].lock);
+	    replay_drain(r);
+	    if (!done)
+		sched_yield();
+	} while (!done);
+    }
+    return NULL;
+}
+
+/*
+ * replay_run - one threaded replay of a trace with n threads, returns
+ *     the time it took (mm is initialized first, but not timed)
+ */
+static double replay_run(trace_t *trace, replay_t *r, inbox_t *in, int n,
+			 int pattern, int libc, int check)
+{
+    pthread_t tid[MAX_THREADS];
+    struct timespec start, end;
+    int i, done;
+
+    if (!libc) {
+	mem_reset_brk();
+	if (mm_init() < 0) 
+	    app_error("mm_init failed in eval_threads");
+    }
+    done = 0;
+    for (i = 0; i < n; i++) {
+	r[i].trace = trace;
+	r[i].thread = i;
+	r[i].nthreads = n;
+	r[i].pattern = pattern;
+	r[i].libc = libc;
+	r[i].inboxes = in;
+	r[i].done = &done;
+	r[i].check = check;
+	r[i].bad_op = -1;
+	in[i].head = in[i].tail = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < n; i++)
+	if (pthread_create(&tid[i], NULL, replay_thread, &r[i]) != 0)
+	    unix_error("pthread_create failed in eval_threads");
+    for (i = 0; i < n; i++)
+	pthread_join(tid[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * eval_threads - replays a (valid) trace for every pattern with 1, 2,
+ *    4, ... max_threads threads and stores the times in the thread_secs
+ *    of stats, every replay takes the best of REPLAY_RUNS runs. With mm
+ *    an untimed checked run comes first: the threads fill their blocks
+ *    and verify them before they free or hand them off, and mm_check
+ *    looks at the heap after the join. Errors are reported like in
+ *    eval_mm_valid and make the trace invalid.
+ */
+static void eval_threads(trace_t *trace, int tracenum, int max_threads, 
+			 int libc, stats_t *stats)
+{
+    replay_t r[MAX_THREADS];
+    inbox_t in[MAX_THREADS];
+    int i, k, n, run, pattern;
+    double secs;
+
+    for (i = 0; i < max_threads; i++) {
+	r[i].ops = (int *)malloc(trace->num_ops * sizeof(int));
+	in[i].blocks = (char **)malloc(trace->num_ops * sizeof(char *));
+	if (r[i].ops == NULL || in[i].blocks == NULL)
+	    unix_error("malloc failed in eval_threads");
+	pthread_mutex_init(&in[i].lock, NULL);
+    }
+
+    for (pattern = 0; pattern < PATTERNS && stats->valid; pattern++) {
+	for (k = 0, n = 1; k < THREAD_COUNTS && n <= max_threads && 
+		 stats->valid; k++, n *= 2) {
+	    /* partition the requests by id */
+	    for (i = 0; i < n; i++)
+		r[i].num_ops = 0;
+	    for (i = 0; i < trace->num_ops; i++) {
+		replay_t *t = &r[trace->ops[i].index % n];
+		t->ops[t->num_ops++] = i;
+	    }
+
+	    if (!libc) {
+		replay_run(trace, r, in, n, pattern, libc, 1);
+		for (i = 0; i < n && stats->valid; i++) {
+		    if (r[i].bad_op >= 0) {
+			sprintf(msg, "%s (%s replay, %d threads)", r[i].bad_msg,
+				pattern_names[pattern], n);
+			malloc_error(tracenum, r[i].bad_op, msg);
+			stats->valid = 0;
+		    }
+		}
+		if (stats->valid && mm_check() != 0) {
+		    sprintf(msg, "mm_check failed after the %s replay with "
+			    "%d threads", pattern_names[pattern], n);
+		    malloc_error(tracenum, trace->num_ops, msg);
+		    stats->valid = 0;
+		}
+		if (!stats->valid)
+		    break;
+	    }
+
+	    stats->thread_secs[pattern][k] = DBL_MAX;
+	    for (run = 0; run < REPLAY_RUNS; run++) {
+		secs = replay_run(trace, r, in, n, pattern, libc, 0);
+		if (secs < stats->thread_secs[pattern][k])
+		    stats->thread_secs[pattern][k] = secs;
+	    }
+	}
+    }
+
+    for (i = 0; i < max_threads; i++) {
+	free(r[i].ops);
+	free(in[i].blocks);
+	pthread_mutex_destroy(&in[i].lock);
+    }
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -926,17 +2103,23 @@ static void printresults(int n, stats_t *stats)
     double util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%6s%9s%9s\n", 
+	   "trace", " valid", "util", "ops", "secs", "Kops", "peak", "final");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
+	    if (stats[i].peak > 0) /* footprints in KB */
+		printf("%8luK%8luK\n", 
+		       (unsigned long)(stats[i].peak/1024),
+		       (unsigned long)(stats[i].final/1024));
+	    else
+		printf("%9s%9s\n", "-", "-");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
@@ -972,6 +2155,218 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printlatency - prints the percentiles of the op latencies (in ns)
+ *    per trace and request type for the mm package
+ */
+static void printlatency(int n, stats_t *stats) 
+{
+    int i, t;
+    hist_t *h;
+
+    printf("%5s%8s%8s%8s%8s%8s%8s%10s\n", 
+	   "trace", "op", "count", "mean", "p50", "p99", "p999", "max");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%11s%8s%8s%8s%8s%8s%10s\n", 
+		   i, "-", "-", "-", "-", "-", "-", "-");
+	    continue;
+	}
+	for (t = 0; t < LAT_TYPES; t++) {
+	    h = &stats[i].lat[t];
+	    if (h->n == 0)
+		continue;
+	    printf("%2d%11s%8ld%8.0f%8lu%8lu%8lu%10lu\n", 
+		   i,
+		   lat_names[t],
+		   h->n,
+		   h->sum / h->n,
+		   hist_percentile(h, 0.50),
+		   hist_percentile(h, 0.99),
+		   hist_percentile(h, 0.999),
+		   h->max);
+	}
+    }
+}
+
+/*
+ * printheapstats - prints the mm_stats of the mm package per trace:
+ *    the heap at the peak footprint (used, mapped, pending, unused slab
+ *    and free KB, the largest free block and the external fragmentation),
+ *    the events counted over the whole trace and the free KB by block
+ *    size at the peak
+ */
+static void printheapstats(int n, stats_t *stats) 
+{
+    int i, b;
+    mm_stats_t *h, *e;
+
+    printf("%5s%9s%9s%9s%9s%9s%9s%6s%8s%7s%9s%9s%7s\n", 
+	   "trace", "used", "mapped", "pending", "slab", "free", "largest", "frag",
+	   "extends", "trims", "coalesce", "splits", "search");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid) {
+	    printf("%2d%12s%9s%9s%9s%9s%9s%6s%8s%7s%9s%9s%7s\n", 
+		   i, "-", "-", "-", "-", "-", "-", "-", "-", "-", "-", "-", "-");
+	    continue;
+	}
+	h = &stats[i].heap_peak;
+	e = &stats[i].heap_end;
+	printf("%2d%12.1f%9.1f%9.1f%9.1f%9.1f%9.1f%5.0f%%%8lu%7lu%9lu%9lu%7.1f\n", 
+	       i,
+	       h->used_bytes / 1024.0,
+	       h->mapped_size / 1024.0,
+	       h->pending_bytes / 1024.0,
+	       h->slab_bytes / 1024.0,
+	       h->free_bytes / 1024.0,
+	       h->largest_free / 1024.0,
+	       h->ext_frag * 100.0,
+	       e->extends,
+	       e->trims,
+	       e->coalesces,
+	       e->splits,
+	       e->searches ? (double)e->search_steps / e->searches : 0.0);
+	if (h->free_blocks == 0)
+	    continue;
+	printf("%5s", "");
+	for (b = 0; b < MM_STATS_BINS; b++)
+	    if (h->free_bins[b] > 0)
+		printf(" %lu+:%.1f", 1UL << b, h->free_bins[b] / 1024.0);
+	printf("\n");
+    }
+}
+
+/*
+ * writelatency - writes the percentiles of the op latencies (in ns)
+ *    to a CSV file (one line per trace and request type) or a JSON
+ *    file (an array with one object per trace and request type)
+ */
+static void writelatency(char *path, int json, char **tracefiles, 
+			 int n, stats_t *stats)
+{
+    FILE *f;
+    int i, t, first = 1;
+    hist_t *h;
+
+    if ((f = fopen(path, "w")) == NULL)
+	unix_error("Could not open latency file");
+
+    if (json)
+	fprintf(f, "[\n");
+    else
+	fprintf(f, "trace,file,op,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	for (t = 0; t < LAT_TYPES; t++) {
+	    h = &stats[i].lat[t];
+	    if (h->n == 0)
+		continue;
+	    if (json) {
+		fprintf(f, "%s  {\"trace\": %d, \"file\": \"%s\", \"op\": \"%s\", "
+			"\"count\": %ld, \"mean_ns\": %.1f, \"p50_ns\": %lu, "
+			"\"p99_ns\": %lu, \"p999_ns\": %lu, \"max_ns\": %lu}", 
+			first ? "" : ",\n", i, tracefiles[i], lat_names[t], 
+			h->n, h->sum / h->n, hist_percentile(h, 0.50), 
+			hist_percentile(h, 0.99), hist_percentile(h, 0.999), h->max);
+		first = 0;
+	    } else {
+		fprintf(f, "%d,%s,%s,%ld,%.1f,%lu,%lu,%lu,%lu\n", 
+			i, tracefiles[i], lat_names[t], 
+			h->n, h->sum / h->n, hist_percentile(h, 0.50), 
+			hist_percentile(h, 0.99), hist_percentile(h, 0.999), h->max);
+	    }
+	}
+    }
+    if (json)
+	fprintf(f, "\n]\n");
+    fclose(f);
+}
+
+/*
+ * printarena - prints the utilization and throughput of the arena
+ *    replays next to the normal ones, the totals are over the traces
+ *    which have both
+ */
+static void printarena(int n, stats_t *stats) 
+{
+    int i, counted = 0;
+    double ops = 0, secs = 0, arena_secs = 0, util = 0, arena_util = 0;
+
+    printf("%5s%8s%7s%7s%8s%8s\n", 
+	   "trace", "phases", "util", "arena", "Kops", "arena");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || !stats[i].arena_valid) {
+	    printf("%2d%11s%7s%7s%8s%8s\n", i, 
+		   stats[i].phases == -2 ? "no mem" : "-", "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%2d%11d%6.0f%%%6.0f%%%8.0f%8.0f\n", 
+	       i,
+	       stats[i].phases,
+	       stats[i].util*100.0,
+	       stats[i].arena_util*100.0,
+	       (stats[i].ops/1e3)/stats[i].secs,
+	       (stats[i].ops/1e3)/stats[i].arena_secs);
+	ops += stats[i].ops;
+	secs += stats[i].secs;
+	arena_secs += stats[i].arena_secs;
+	util += stats[i].util;
+	arena_util += stats[i].arena_util;
+	counted++;
+    }
+    if (errors == 0 && counted > 0)
+	printf("%13s%6.0f%%%6.0f%%%8.0f%8.0f\n", 
+	       "Total        ",
+	       (util/counted)*100.0,
+	       (arena_util/counted)*100.0,
+	       (ops/1e3)/secs,
+	       (ops/1e3)/arena_secs);
+}
+
+/*
+ * printthreads - prints the aggregate throughput (over all valid traces)
+ *    of the threaded replays and the speedup over one thread, for mm
+ *    and, if it has been run (-l), libc malloc
+ */
+static void printthreads(int n, int max_threads, stats_t *mm_stats, 
+			 stats_t *libc_stats)
+{
+    int i, k, t, pattern;
+    double ops, secs, kops, base[2];
+    stats_t *stats;
+
+    printf("%9s%8s%10s%8s", "pattern", "threads", "mm Kops", "speedup");
+    if (libc_stats)
+	printf("%11s%8s", "libc Kops", "speedup");
+    printf("\n");
+    for (pattern = 0; pattern < PATTERNS; pattern++) {
+	for (k = 0, t = 1; k < THREAD_COUNTS && t <= max_threads; k++, t *= 2) {
+	    printf("%9s%8d", pattern_names[pattern], t);
+	    for (i = 0; i < 2; i++) {
+		int j;
+		stats = (i == 0) ? mm_stats : libc_stats;
+		if (stats == NULL)
+		    break;
+		ops = 0;
+		secs = 0;
+		for (j = 0; j < n; j++) {
+		    if (stats[j].valid && mm_stats[j].valid) {
+			ops += stats[j].ops;
+			secs += stats[j].thread_secs[pattern][k];
+		    }
+		}
+		kops = (secs > 0) ? (ops / 1e3) / secs : 0;
+		if (k == 0)
+		    base[i] = kops;
+		printf("%*.0f%8.2f", (i == 0) ? 10 : 11, kops, 
+		       base[i] > 0 ? kops / base[i] : 0);
+	    }
+	    printf("\n");
+	}
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +2399,24 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValLSA] [-f <file>] [-t <dir>] [-c <file>] [-j <file>] [-T <n>]\n");
+    fprintf(stderr, "               [-H <file> [-i <n>]]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A         Replay the traces with an mm arena too.\n");
+    fprintf(stderr, "\t-c <file>  Write the latencies to <file> as CSV (implies -L).\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <file>  Write snapshots of the mm heap to <file> (see heapviz).\n");
+    fprintf(stderr, "\t-i <n>     Take a heap snapshot every <n> requests (default %d).\n",
+	    TIMELINE_INTERVAL);
+    fprintf(stderr, "\t-j <file>  Write the latencies to <file> as JSON (implies -L).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Measure the latency of every mm op (in ns).\n");
+    fprintf(stderr, "\t-S         Print the heap statistics of mm per trace.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Replay the traces with 1, 2, 4, ... <n> threads too.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
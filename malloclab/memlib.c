@@ -3,6 +3,7 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,6 +11,7 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
@@ -18,6 +20,46 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static size_t mem_peak;      /* biggest footprint since the last reset */
+static char *mem_fresh;      /* heap bytes from here on have never been used */
+static int mem_quiet;        /* don't report running out of memory */
+
+/* regions mapped outside of the heap with mem_map */
+typedef struct map_t {
+    char *lo;                /* first byte of the region */
+    size_t size;             /* size of the region in bytes */
+    struct map_t *next;
+} map_t;
+static map_t *mem_maps;      /* list of the mapped regions */
+static size_t mem_mapped;    /* bytes in mapped regions */
+
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER; /* protects the state above */
+
+/*
+ * update_peak - remembers the current footprint if it is the biggest
+ *    so far, mem_lock has to be held
+ */
+static void update_peak(void)
+{
+    size_t footprint = (size_t)(mem_brk - mem_start_brk) + mem_mapped;
+
+    if (footprint > mem_peak)
+	mem_peak = footprint;
+}
+
+/*
+ * unmap_all - unmaps all regions mapped with mem_map
+ */
+static void unmap_all(void)
+{
+    while (mem_maps != NULL) {
+	map_t *m = mem_maps;
+	mem_maps = m->next;
+	munmap(m->lo, m->size);
+	free(m);
+    }
+    mem_mapped = 0;
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -25,13 +67,15 @@ static char *mem_max_addr;   /* largest legal heap address */
 void mem_init(void)
 {
     /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
+    if ((mem_start_brk = (char *)calloc(1, MAX_HEAP)) == NULL) {
 	fprintf(stderr, "mem_init_vm: malloc error\n");
 	exit(1);
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_fresh = mem_start_brk;                /* and zero */
+    mem_peak = 0;
 }
 
 /* 
@@ -40,6 +84,16 @@ void mem_init(void)
 void mem_deinit(void)
 {
     free(mem_start_brk);
+    unmap_all();
+}
+
+/*
+ * mem_set_quiet - while quiet is set, running out of memory is not
+ *    reported on stderr (for callers which run out on purpose)
+ */
+void mem_set_quiet(int quiet)
+{
+    mem_quiet = quiet;
 }
 
 /*
@@ -48,26 +102,178 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    unmap_all();
+    mem_peak = 0;
+}
+
+/*
+ * release_pages - releases the whole pages in [lo, hi)
+ */
+static void release_pages(char *lo, char *hi)
+{
+    size_t pagesize = mem_pagesize();
+
+    lo = (char *)(((size_t)lo + pagesize - 1) & ~(pagesize - 1));
+    hi = (char *)((size_t)hi & ~(pagesize - 1));
+    if (lo < hi)
+	madvise(lo, hi - lo, MADV_DONTNEED);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    A negative incr shrinks the heap (and returns the old brk), but
+ *    not below its start, the pages above the new brk are released.
+ *    mem_sbrk may be called by several threads at the same time.
  */
 void *mem_sbrk(int incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    pthread_mutex_lock(&mem_lock);
+    old_brk = mem_brk;
+    if ( ((mem_brk + incr) < mem_start_brk) || ((mem_brk + incr) > mem_max_addr)) {
+	pthread_mutex_unlock(&mem_lock);
 	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	if (!mem_quiet)
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+    if (mem_brk > mem_fresh)
+	mem_fresh = mem_brk;
+    update_peak();
+    if (incr < 0)
+	release_pages(mem_brk, old_brk);
+    pthread_mutex_unlock(&mem_lock);
     return (void *)old_brk;
 }
 
+/*
+ * mem_release - tells the system that the contents of the heap bytes
+ *    [addr, addr+len) are not needed anymore, so it can take back their
+ *    pages (with madvise). Only the whole pages inside the range are
+ *    released, they read as zero when they are used again.
+ */
+void mem_release(void *addr, size_t len)
+{
+    char *lo = (char *)addr;
+
+    if (lo >= mem_start_brk && lo + len <= mem_brk)
+	release_pages(lo, lo + len);
+}
+
+/*
+ * mem_map - models mmap of an anonymous region of size bytes (a
+ *    multiple of the page size) outside of the heap. Returns the start
+ *    address of the region, or (void *)-1 if there is no memory.
+ *    Regions which are still mapped are unmapped by mem_reset_brk.
+ */
+void *mem_map(size_t size)
+{
+    map_t *m;
+    char *lo;
+
+    if ((m = (map_t *)malloc(sizeof(map_t))) == NULL)
+	return (void *)-1;
+    lo = mmap(NULL, size, PROT_READ | PROT_WRITE, 
+	      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (lo == MAP_FAILED) {
+	free(m);
+	if (!mem_quiet)
+	    fprintf(stderr, "ERROR: mem_map failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+
+    m->lo = lo;
+    m->size = size;
+    pthread_mutex_lock(&mem_lock);
+    m->next = mem_maps;
+    mem_maps = m;
+    mem_mapped += size;
+    update_peak();
+    pthread_mutex_unlock(&mem_lock);
+    return lo;
+}
+
+/*
+ * find_map - returns the link to the record of the region starting
+ *    at lo (it has to exist), mem_lock has to be held
+ */
+static map_t **find_map(void *lo)
+{
+    map_t **mp;
+
+    for (mp = &mem_maps; *mp != NULL; mp = &(*mp)->next)
+	if ((*mp)->lo == lo)
+	    return mp;
+
+    fprintf(stderr, "ERROR: %p is not a region of mem_map\n", lo);
+    exit(1);
+}
+
+/*
+ * mem_unmap - models munmap of a whole region returned by mem_map
+ */
+void mem_unmap(void *addr)
+{
+    map_t **mp, *m;
+
+    pthread_mutex_lock(&mem_lock);
+    mp = find_map(addr);
+    m = *mp;
+    *mp = m->next;
+    mem_mapped -= m->size;
+    pthread_mutex_unlock(&mem_lock);
+
+    munmap(m->lo, m->size);
+    free(m);
+}
+
+/*
+ * mem_remap - models mremap, resizes the region at addr (returned by
+ *    mem_map) to size bytes, moving it if needed. Returns the new start
+ *    address, or (void *)-1 if there is no memory (the region is left
+ *    as it was).
+ */
+void *mem_remap(void *addr, size_t size)
+{
+    map_t *m;
+    char *lo;
+
+    pthread_mutex_lock(&mem_lock);
+    m = *find_map(addr);
+    lo = mremap(m->lo, m->size, size, MREMAP_MAYMOVE);
+    if (lo == MAP_FAILED) {
+	pthread_mutex_unlock(&mem_lock);
+	if (!mem_quiet)
+	    fprintf(stderr, "ERROR: mem_remap failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+    mem_mapped += size - m->size;
+    m->lo = lo;
+    m->size = size;
+    update_peak();
+    pthread_mutex_unlock(&mem_lock);
+    return lo;
+}
+
+/*
+ * mem_is_mapped - returns 1 if the bytes [lo, hi] lie in one region
+ *    of mem_map, 0 otherwise
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    map_t *m;
+    int found = 0;
+
+    pthread_mutex_lock(&mem_lock);
+    for (m = mem_maps; m != NULL && !found; m = m->next)
+	found = ((char *)lo >= m->lo && (char *)hi < m->lo + m->size);
+    pthread_mutex_unlock(&mem_lock);
+    return found;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -84,6 +290,16 @@ void *mem_heap_hi()
     return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_heap_fresh - return the address from which on the heap bytes
+ *    have never been used since mem_init, like new memory of the
+ *    system they read as zero (a reset heap is used memory)
+ */
+void *mem_heap_fresh()
+{
+    return (void *)mem_fresh;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
@@ -92,6 +308,23 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_mapsize() - returns the number of bytes in mapped regions
+ */
+size_t mem_mapsize() 
+{
+    return mem_mapped;
+}
+
+/*
+ * mem_peak_footprint() - returns the biggest footprint (heap size plus
+ *    mapped bytes) since the heap was initialized (or reset)
+ */
+size_t mem_peak_footprint() 
+{
+    return mem_peak;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
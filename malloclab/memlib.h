@@ -3,9 +3,18 @@
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+void mem_release(void *addr, size_t len);
+void *mem_map(size_t size);
+void mem_unmap(void *addr);
+void *mem_remap(void *addr, size_t size);
+int mem_is_mapped(void *lo, void *hi);
 void mem_reset_brk(void); 
+void mem_set_quiet(int quiet);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_fresh(void);
 size_t mem_heapsize(void);
+size_t mem_mapsize(void);
+size_t mem_peak_footprint(void);
 size_t mem_pagesize(void);
 
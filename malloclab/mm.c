@@ -1,23 +1,99 @@
 /*
  * mm.c
  *
- * Our Implementation is in general a simple free list.
- * We use a header and footer tags for each block which
- * stores the length of the block and in one bit if the block
- * is used or free. The next and prev pointer for the free lists
+ * Our Implementation uses segregated free lists.
+ * Every block has a header tag which stores the length of the block,
+ * in one bit if the block is used or free and in a second bit if the
+ * previous block is used or free. Only free blocks have a footer tag
+ * (a copy of the header) at their end: it is needed to find the start
+ * of a free block when the block after it gets coalesced, the header bit
+ * tells if there is a footer to look at. The next and prev links for the free lists
  * are placed in the content of the block at offset 0 and 4 (so
- * blocks always have to be at least 8 bytes + 2*4 bytes for hdr and ftr).
- * The allocation strategy we use is first fit, we also tried best fit
- * but first fit gives us better performance.
+ * blocks always have to be at least sizeof(node) bytes + 2*4 bytes for hdr and ftr).
+ * Tags and links are 32 bit on 64 bit machines too: the links are offsets
+ * from the start of the heap, not pointers. Payloads are ALIGNMENT
+ * (16 by default) aligned.
+ * Free blocks are kept in NUM_CLASSES lists indexed in two levels (like
+ * TLSF): the first level is the power of two of the size, the second
+ * level divides it in SL_COUNT equal ranges (blocks smaller than
+ * SMALL_BLOCK_SIZE are all in first level 0, divided linearly).
+ * A bitmap per level tells which lists are non empty.
+ * The list heads and second level bitmaps are stored in front of the prologue block.
+ * The allocation strategy we use is good fit: we try the first
+ * FIT_SCAN_LIMIT blocks in the class of the request (some of them can be
+ * too small), then take the first block of the next non empty class,
+ * which the bitmaps give us in O(1) - every block in a bigger class fits.
+ * A full best fit (scanning the lists) was too slow on big heaps.
+ * The policies can be changed at compile time to compare them: first or
+ * best fit (FIT_POLICY), lists sorted by address (LIST_ORDER), coalescing
+ * in free instead of the pending blocks below (COALESCE_MODE) and the
+ * smallest rest which is split off a block (SPLIT_THRESHOLD). Lists sorted
+ * by address keep an index of the heap regions, so an insert only walks
+ * the blocks of one region instead of the whole list.
  * The allocator code frees blocks lazily - so in case free is
- * invoked, the block gets placed in a list called tofree_list
- * then on the next malloc call we walk through this tofree list,
- * coalescing these blocks and put them into the real free list.
+ * invoked, the block stays marked allocated and is kept pending:
+ * blocks up to QUICK_MAX_SIZE bytes go into a quick list of their exact
+ * size, where the next malloc of that size takes them in O(1), bigger
+ * ones into a list called tofree_list. Pending blocks are coalesced
+ * and put into the real free lists at most COALESCE_BATCH at a time:
+ * by a free when more than 1/PENDING_RATIO of the heap is pending, and
+ * by a malloc which finds no fit (up to MISS_COALESCE_LIMIT blocks before
+ * it extends the heap), so no call has to coalesce all of them.
+ * The heap shrinks again: after pending blocks are coalesced, a free last
+ * block of TRIM_THRESHOLD bytes is cut down with a negative mem_sbrk,
+ * and the pages of freed blocks of RELEASE_THRESHOLD bytes are released.
  *
- * Our realloc strategy is that we first check if the block on the
- * left and on the right is free, we coalesce them and check if it
- * fits the space requirements of realloc (in this case we return)
- * otherwise we just do realloc based on free and malloc.
+ * Requests of MMAP_THRESHOLD bytes or more don't use the heap at all,
+ * every such block gets its own region from mem_map. In front of the
+ * payload we store the size of the mapping and a header with size 0
+ * (which no block of the heap has), so free and realloc can tell a mapped
+ * block apart. Realloc resizes the mapping with mem_remap, the data
+ * is not copied.
+ *
+ * Our realloc strategy is to grow blocks in place: first into the next
+ * block if it is free, then (for the last block of the heap) by extending
+ * the heap just by the missing bytes. Only if both fail we coalesce
+ * a batch of pending blocks and try again, then coalesce with the
+ * previous block (moving the data down), and as a last resort we do
+ * realloc based on free and malloc. Blocks which have been grown by
+ * realloc get the REALLOC_TAG bit, when such a block has to move we
+ * give it REALLOC_RESERVE more bytes, so the next calls don't have to
+ * move it again.
+ *
+ * Calloc only clears what could be dirty: mappings are new memory, and
+ * so is a block placed at the end of the heap after extend_heap, up to
+ * the bytes the allocator wrote into it (see mem_heap_fresh). Memalign
+ * places the block at an aligned address inside a free block and gives
+ * the part in front of it back to the free lists. A batch of heap blocks
+ * is carved out of one block of up to BATCH_MAX_SIZE bytes, so it takes
+ * one search instead of one per block; a batch free takes heap_lock once.
+ * With the size known, a sized free finds the cache bin of a slot without
+ * reading the slab header.
+ *
+ * Arenas sit on top of mm_malloc: an arena gets chunks of chunk_size bytes
+ * from mm_malloc and bumps a pointer through the newest one, its blocks
+ * have no header and are never freed one by one. A reset gives all
+ * chunks but the newest back with mm_free and starts over in that one.
+ *
+ * Requests up to SLAB_MAX_SIZE bytes don't get a block of their own.
+ * They are served from slabs: SLAB_SIZE bytes big, SLAB_SIZE aligned
+ * (allocated) blocks of the heap which are divided into slots of equal
+ * size, one slot size per multiple of ALIGNMENT. Slots have no header
+ * and footer, the slab header at the start of the slab keeps the size
+ * class, a list of freed slots and a bump pointer to the part of the slab
+ * which has never been used. mm_free finds the slab of a slot by masking
+ * the address, slab_map tells whether an aligned address is really a slab.
+ * Slabs with free slots are kept in one list per class, a slab which gets
+ * empty is given back to the heap (unless it is the last one of its class).
+ *
+ * The allocator can be used by multiple threads: the heap described
+ * above (free lists, pending blocks, extend_heap, slabs) is shared and
+ * protected by heap_lock. In front of it every thread has a small cache
+ * of slots, one bin per slab class. Cached slots stay allocated in their
+ * slab, so malloc and free of small blocks don't need the lock as long
+ * as the bin of the thread is not empty (or full). Slots move between a
+ * cache and the slabs in batches of TCACHE_BATCH slots. A slot can be
+ * freed by any thread: it simply ends up in the cache of the freeing thread.
  *
  */
 
@@ -25,7 +101,9 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
-#include <string.h> // for memcpy
+#include <string.h> // for memcpy, memmove
+#include <stdint.h> // for uintptr_t, SIZE_MAX
+#include <pthread.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -44,53 +122,311 @@ team_t team = {
     "borisb@student.ethz.ch"
 };
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
+/* payload alignment: 16 (default, SIMD types) or 8, has to match the
+ * ALIGNMENT the driver checks (see config.h and the Makefile) */
+#ifndef ALIGNMENT
+#define ALIGNMENT 16
+#endif
 #define WSIZE 4
 #define DSIZE 8
 #define CHUNKSIZE (1<<10)
-#define OVERHEAD 8
+#define REALLOC_RESERVE(asize) ALIGN((asize) / 4) /* extra bytes for a moved, growing block */
+#define OVERHEAD 4 /* header of an allocated block */
+#define TRIM_THRESHOLD (1<<17) /* a free last block this big is given back with mem_sbrk */
+#define RELEASE_THRESHOLD (1<<16) /* the pages of a free block this big are released */
+#define BATCH_MAX_SIZE (1<<14) /* mm_malloc_batch carves up blocks of up to this size */
+#define ARENA_CHUNK_SIZE (1<<14) /* default size of the chunks of an arena */
+#define ARENA_BIG_RATIO 4 /* blocks over 1/ARENA_BIG_RATIO of a chunk get a chunk of their own */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (1<<17) /* requests of at least this many bytes get their own mapping */
+#endif
+
+/* allocation policies, chosen at compile time (the Makefile builds
+ * drivers with other policies, see variants.sh) */
+#define FIT_GOOD 0 /* the best of FIT_SCAN_LIMIT blocks of the class, else the next class */
+#define FIT_FIRST 1 /* the first block which fits */
+#define FIT_BEST 2 /* the smallest block of the class, else of the next class */
+#ifndef FIT_POLICY
+#define FIT_POLICY FIT_GOOD
+#endif
+#define ORDER_LIFO 0 /* free blocks are put in front of their list */
+#define ORDER_ADDRESS 1 /* free lists are sorted by address */
+#ifndef LIST_ORDER
+#define LIST_ORDER ORDER_LIFO
+#endif
+#define COALESCE_DEFERRED 0 /* freed blocks are pending, coalesced in batches */
+#define COALESCE_IMMEDIATE 1 /* freed blocks are coalesced by free */
+#ifndef COALESCE_MODE
+#define COALESCE_MODE COALESCE_DEFERRED
+#endif
+#ifndef SPLIT_THRESHOLD
+#define SPLIT_THRESHOLD MIN_BLOCK_SIZE /* smallest rest which is split off a block */
+#endif
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
-/* Pack a size and allocate bit into a word */
+/* Pack a size and allocate bits into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
+#define ALLOC 0x1 /* the block is allocated */
+#define PREV_ALLOC 0x2 /* the previous block is allocated */
+#define REALLOC_TAG 0x4 /* the (allocated) block has been grown by realloc */
 
 /* Read and write a word at address p */
-#define GET(p)  (*(size_t *)(p))
-#define PUT(p, val)  (*(size_t *)(p) = (val))
+#define GET(p)  (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (val))
 
 /* Read size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~0x7)
-#define IS_ALLOCATED(p) (GET(p) & 0x1)
+#define IS_ALLOCATED(p) (GET(p) & ALLOC)
+#define IS_PREV_ALLOCATED(p) (GET(p) & PREV_ALLOC)
+#define IS_REALLOC_TAGGED(p) (GET(p) & REALLOC_TAG)
 
-/* Given block ptr bp compute address of its header and footer */
+/* Given block ptr bp compute address of its header and footer (free blocks only) */
 #define HDRP(bp)  ((char*)(bp) - WSIZE)
 #define FTRP(bp)  ((char*)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks
+ * (PREV_BLKP only works if the previous block is free) */
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
 /* rounds up to the nearest multiple of ALIGNMENT */
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 
-/* free block ptr structure, next and prev ptr for free list */
+/* mapped blocks: the mapping size (a size_t) and the header are in front of the payload */
+#define MMAP_OVERHEAD ALIGN(sizeof(size_t) + WSIZE)
+#define MAP_SIZE(size) (((size) + MMAP_OVERHEAD + mem_pagesize()-1) & ~(mem_pagesize()-1))
+#define MAPPED_SIZE(bp) (*(size_t*) ((char*)(bp) - MMAP_OVERHEAD))
+#define IS_MAPPED(bp) (GET(HDRP(bp)) == PACK(0, ALLOC))
+
+/* free block structure, next and prev link for free list,
+ * a link is the offset of the block from heap_lo (0 for NULL) */
 struct fnode {
-	struct fnode* prev;
-	struct fnode* next;
+	unsigned int prev;
+	unsigned int next;
 };
 typedef struct fnode node;
 
+/* convert between links and block pointers */
+#define TO_LINK(bp) ((bp) == NULL ? 0 : (unsigned int) ((char*)(bp) - heap_lo))
+#define FROM_LINK(link) ((link) == 0 ? NULL : (node*) (heap_lo + (link)))
+#define NEXT_FREE(n) FROM_LINK((n)->next)
+#define PREV_FREE(n) FROM_LINK((n)->prev)
+
+/* segregated free lists (size classes), two level index */
+#define SL_LOG2 2 /* at most 3, sl_bitmap has 8 bits per first level */
+#define SL_COUNT (1<<SL_LOG2) /* second level lists per first level */
+#define FL_MIN_SHIFT 7
+#define SMALL_BLOCK_SIZE (1<<FL_MIN_SHIFT) /* smaller blocks are in first level 0 */
+#define FL_MAX_SHIFT 25 /* blocks are smaller than 32MB (MAX_HEAP of memlib is 20MB) */
+#define FL_COUNT (FL_MAX_SHIFT - FL_MIN_SHIFT + 1)
+#define NUM_CLASSES (FL_COUNT * SL_COUNT)
+#define FIT_SCAN_LIMIT 8 /* blocks tried in the class of a request */
+
+/* pending (freed, not yet coalesced) blocks */
+#define QUICK_MAX_SIZE 512 /* freed blocks up to this size go to a quick list */
+#define QUICK_BINS (QUICK_MAX_SIZE / ALIGNMENT) /* at most 64 (bits of quick_bitmap) */
+#define QUICK_BIN(size) ((size) / ALIGNMENT - 1)
+#define COALESCE_BATCH 4 /* pending blocks coalesced by a free */
+#define PENDING_RATIO 8 /* frees coalesce if more than heapsize/PENDING_RATIO bytes are pending */
+#define MISS_COALESCE_LIMIT 64 /* pending blocks coalesced by a malloc without fit */
+
+/* smallest block which can hold the free list pointers */
+#define MIN_BLOCK_SIZE ALIGN(sizeof(node) + 2*WSIZE) /* incl. hdr and ftr */
+_Static_assert(SPLIT_THRESHOLD >= MIN_BLOCK_SIZE, "SPLIT_THRESHOLD is below MIN_BLOCK_SIZE");
+
 /* start heap */
 static char* heap_listp;
 
-/* pointer to free list start */
-static size_t* free_listp;
+/* first byte of the heap (mem_heap_lo), the base of free list links */
+static char* heap_lo;
+
+/* free list heads (as links), one per size class (stored in the prologue area) */
+static unsigned int* seg_listp;
+
+/* which lists are non empty: bit fl of fl_bitmap is set if any list
+ * of first level fl is, bit sl of sl_bitmap[fl] if list (fl, sl) is
+ * (sl_bitmap is stored in the prologue area) */
+static unsigned int fl_bitmap;
+static unsigned char* sl_bitmap;
+
+#if LIST_ORDER == ORDER_ADDRESS
+/* index of the sorted free lists: the heap is divided into regions of
+ * 1<<REGION_SHIFT bytes, region_head has the first block (as link) of
+ * every list in every region, bit r of region_bitmap[class] is set if
+ * the list has blocks in region r, tail_listp has the last block of
+ * every list; an insert only walks the blocks of its region */
+#define REGION_SHIFT 16
+#define REGIONS ((1<<FL_MAX_SHIFT) >> REGION_SHIFT) /* the heap is smaller than 2^FL_MAX_SHIFT */
+#define REGION(bp) (TO_LINK(bp) >> REGION_SHIFT)
+#define HAS_REGION(class, r) ((region_bitmap[class][(r) / 64] >> ((r) % 64)) & 1)
+static unsigned int region_head[NUM_CLASSES][REGIONS];
+static uint64_t region_bitmap[NUM_CLASSES][REGIONS / 64];
+static unsigned int tail_listp[NUM_CLASSES];
+#endif
 
 /* to be freed list start */
 static size_t* tofree_listp;
 
+/* quick lists of pending blocks, one per size, single linked with the
+ * next link, bit i of quick_bitmap is set if list i is non empty */
+static unsigned int quick_listp[QUICK_BINS];
+static uint64_t quick_bitmap;
+
+static size_t pending_size; /* bytes in the tofree and quick lists */
+
+/* events counted for mm_stats (only the event fields are used) */
+static mm_stats_t events;
+
+/* single linked list of free (or cached) slots, stored in the slot */
+struct cnode {
+	struct cnode* next;
+};
+typedef struct cnode cnode;
+
+/* slabs for small requests */
+#define SLAB_SIZE 4096 /* size and alignment of a slab (a page) */
+#define SLAB_MAX_SIZE 120 /* biggest request served from a slab (a 128 bytes block) */
+#define SLAB_CLASS(size) ((size) > 0 ? ((size)-1) / ALIGNMENT : 0)
+#define SLAB_CLASSES (SLAB_CLASS(SLAB_MAX_SIZE) + 1)
+#define SLOT_SIZE(class) (((class)+1) * ALIGNMENT)
+#define SLAB_OF(bp) ((slab*) ((uintptr_t)(bp) & ~(uintptr_t)(SLAB_SIZE-1)))
+#define SLAB_MAP_SIZE ((20*(1<<20)) / SLAB_SIZE + 1) /* covers MAX_HEAP of memlib */
+
+/* slab header, stored at the start of the slab, the slots follow it */
+struct slab {
+	struct slab* prev; /* list of slabs with free slots of this class */
+	struct slab* next;
+	cnode* free; /* freed slots */
+	char* bump; /* first slot which has never been used */
+	unsigned int class;
+	unsigned int used; /* slots in use (including the ones in thread caches) */
+};
+typedef struct slab slab;
+
+/* a slab is a heap block of exactly SLAB_SIZE bytes (so slabs can lie
+ * back to back), the header of the next block takes the end of the page */
+#define SLAB_HDR_SIZE ALIGN(sizeof(slab))
+#define SLAB_END(s) ((char*)(s) + SLAB_SIZE - OVERHEAD)
+#define SLAB_SLOTS(class) ((SLAB_SIZE - OVERHEAD - SLAB_HDR_SIZE) / SLOT_SIZE(class))
+#define SLAB_IS_FULL(s) ((s)->free == NULL && \
+		(s)->bump + SLOT_SIZE((s)->class) > SLAB_END(s))
+
+/* slab list heads, one per slab class (stored in the prologue area) */
+static slab** slab_listp;
+
+/* first SLAB_SIZE aligned address at or below the heap */
+static char* slab_base;
+
+/* one entry per SLAB_SIZE aligned address from slab_base on,
+ * non zero if there is a slab at this address */
+static unsigned char slab_map[SLAB_MAP_SIZE];
+
+/* protects all of the above (and everything reachable from it) */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* thread caches for slots */
+#define TCACHE_BINS SLAB_CLASSES /* one bin per slab class */
+#define TCACHE_MAX_COUNT 16 /* max. number of slots per bin */
+#define TCACHE_BATCH 4 /* slots moved between cache and slabs at once */
+
+struct thread_cache {
+	unsigned int generation; /* heap_generation the cached slots belong to */
+	cnode* bins[TCACHE_BINS];
+	int counts[TCACHE_BINS];
+};
+
+/* incremented by mm_init, invalidates the blocks in all thread caches */
+static unsigned int heap_generation = 0;
+
+static __thread struct thread_cache tcache;
+
+/* a chunk of an arena, the blocks follow the (aligned) chunk header */
+typedef struct arena_chunk {
+	struct arena_chunk* next;
+	size_t size; /* bytes behind the header */
+} arena_chunk;
+#define ARENA_CHUNK_HEADER ALIGN(sizeof(arena_chunk))
+
+/* an arena (mm_arena_t of mm.h) */
+struct mm_arena {
+	arena_chunk* chunks; /* the chunk we bump through first, then the others */
+	char* bump; /* next free byte of the first chunk */
+	char* end; /* end of the first chunk */
+	size_t chunk_size;
+};
+
+/* used to flush the cache of a thread when it exits */
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+
+/*
+ * size_class
+ *  - maps a block size to the index of its free list: fl*SL_COUNT + sl
+ *  - first level 0: size < SMALL_BLOCK_SIZE, in SL_COUNT equal steps
+ *  - first level fl > 0: 2^(fl+FL_MIN_SHIFT-1) <= size < 2^(fl+FL_MIN_SHIFT),
+ *    the second level are the next SL_LOG2 bits after the highest one
+ *  - (blocks of 2^FL_MAX_SHIFT bytes or more can't exist, they would go to the last class)
+ */
+static int size_class(size_t size) {
+	int fl, sl, log2;
+
+	if(size < SMALL_BLOCK_SIZE) {
+		fl = 0;
+		sl = size / (SMALL_BLOCK_SIZE / SL_COUNT);
+	} else {
+		log2 = 31 - __builtin_clz((unsigned int) size);
+		if(log2 >= FL_MAX_SHIFT)
+			return NUM_CLASSES-1;
+		fl = log2 - FL_MIN_SHIFT + 1;
+		sl = (size >> (log2 - SL_LOG2)) & (SL_COUNT-1);
+	}
+
+	return fl*SL_COUNT + sl;
+}
+
+/*
+ * next_class
+ *  - uses the bitmaps to find the first non empty free list
+ *    with an index >= class
+ *  @return the index of the list or -1 if all these lists are empty
+ */
+static int next_class(int class) {
+	int fl = class / SL_COUNT;
+	unsigned int sl_map;
+
+	if(class >= NUM_CLASSES)
+		return -1;
+
+	sl_map = sl_bitmap[fl] & (~0U << (class % SL_COUNT));
+	if(sl_map == 0) {
+		// no list left in this first level, take the next non empty one
+		unsigned int fl_map = fl_bitmap & (~0U << fl) & ~(1U << fl);
+		if(fl_map == 0)
+			return -1;
+		fl = __builtin_ctz(fl_map);
+		sl_map = sl_bitmap[fl];
+	}
+
+	return fl*SL_COUNT + __builtin_ctz(sl_map);
+}
+
+/*
+ * slab_of
+ *  - finds the slab a block pointer belongs to
+ *  @return the slab of bp or NULL if bp is not a slot (but a normal block)
+ */
+static slab* slab_of(void* bp) {
+	size_t index = ((char*)SLAB_OF(bp) - slab_base) / SLAB_SIZE;
+
+	if((char*)bp < slab_base || index >= SLAB_MAP_SIZE || !slab_map[index])
+		return NULL;
+
+	return SLAB_OF(bp);
+}
+
 
 /*
  * Macro for Debugging
@@ -106,44 +442,140 @@ static size_t* tofree_listp;
  * mm_check - consistency checker for heap space and free lists
  * The consistency checker checks the following invariants:
  * 	1. All blocks in the free list are marked as free.
- * 	2. Pointer in the free list structure always point to addresses in range [mem_heap_lo, mem_heap_hi]
+ * 	1d. With ORDER_ADDRESS the free lists are sorted by address and
+ * 	    the region index knows the first block of every region
+ * 	2. Links in the free list structure always point to addresses in range [mem_heap_lo, mem_heap_hi]
  * 	3. Foreach free block in heap: Block neighbours are allocated
  * 	4. Foreach marked free block in heap: Block is in the free list
+ * 	4b. Foreach block: the prev allocated bit is right, free blocks have a footer
+ * 	5. Slabs in the slab lists are not full and have the right class,
+ * 	   their free slots are inside the slab
+ * 	6. Pending blocks are marked allocated, quick list blocks have the size
+ * 	   of their list, pending_size is right
  * 	Note: make sure to call mm_check only at the beginning or at the end of client functions (mm_free, mm_malloc, mm_realloc)
  * 	otherwise there is no guarantee that the heap is in a consistent state!
  * 	Note: Make sure to set DEBUG to 1 to get output from mm_check!
+ * 	@return 0 if all invariants hold, -1 (after printing the error) otherwise
  */
 int mm_check() {
 	//printf("\nMem low is %p\n", mem_heap_lo());
 	//printf("Mem high is %p\n", mem_heap_hi());
 
-	// First we do some check on the free list itself
-	if(free_listp != NULL) {
-		node* current = (node*) free_listp;
+	// First we do some check on the free lists itself
+	int class;
+	for(class=0; class<NUM_CLASSES; class++) {
+		node* current = FROM_LINK(seg_listp[class]);
+
+		// 1c. Do the bitmaps know if the list is empty?
+		if( (current != NULL) != ((sl_bitmap[class / SL_COUNT] >> (class % SL_COUNT)) & 1) ||
+				(sl_bitmap[class / SL_COUNT] != 0) != ((fl_bitmap >> (class / SL_COUNT)) & 1) ) {
+			DEBUG_PRINT("Error: Bitmaps are wrong for free list %d!", class);
+			return -1;
+		}
+
 		while(current != NULL) {
 
 			// 1. Are all blocks in the free list marked as free?
 			if(IS_ALLOCATED(HDRP(current))) {
 				DEBUG_PRINT("Error: Allocated Block in free list at %p!", current);
-				exit(1);
+				return -1;
+			}
+
+			// 1b. Is the block in the list of its size class?
+			if(size_class(GET_SIZE(HDRP(current))) != class) {
+				DEBUG_PRINT("Error: Block %p in free list of wrong size class!", current);
+				return -1;
+			}
+
+			// 2. Do the links in the free list point to valid heap addresses?
+			if( current->next >= mem_heapsize() ) {
+				DEBUG_PRINT("Error: Free list next link at element %p points out of the heap!", current);
+				return -1;
+			}
+			if( current->prev >= mem_heapsize() ) {
+				DEBUG_PRINT("Error: Free list prev link at element %p points out of the heap!", current);
+				return -1;
+			}
+
+#if LIST_ORDER == ORDER_ADDRESS
+			// 1d. Is the list sorted and indexed?
+			if(current->next != 0 && (char*)NEXT_FREE(current) < (char*)current) {
+				DEBUG_PRINT("Error: Free list %d is not sorted at %p!", class, current);
+				return -1;
+			}
+			if((current->prev == 0 || REGION(PREV_FREE(current)) != REGION(current)) &&
+					(!HAS_REGION(class, REGION(current)) ||
+					 region_head[class][REGION(current)] != TO_LINK(current))) {
+				DEBUG_PRINT("Error: Region index of free list %d is wrong at %p!", class, current);
+				return -1;
 			}
+			if(current->next == 0 && tail_listp[class] != TO_LINK(current)) {
+				DEBUG_PRINT("Error: Tail of free list %d is wrong!", class);
+				return -1;
+			}
+#endif
+
+			current = NEXT_FREE(current); // continue with next element...
+		}
+	}
 
-			// 2. Do the pointers in the free list point to valid heap addresses?
-			if( current->next != NULL && ( ((void*)current->next) < mem_heap_lo() ||  ((void*)current->next) > mem_heap_hi()) ) {
-				DEBUG_PRINT("Error: Free list next pointer at element %p points out of the heap!", current);
-				exit(1);
+	// 5. Check the slabs which have free slots
+	for(class=0; class<SLAB_CLASSES; class++) {
+		slab* current = slab_listp[class];
+		while(current != NULL) {
+			if(slab_of(current) != current || current->class != class) {
+				DEBUG_PRINT("Error: Slab %p in slab list of wrong class!", current);
+				return -1;
 			}
-			if( current->prev != NULL && (((void*)current->prev) < mem_heap_lo() || ((void*)current->prev) > mem_heap_hi()) ) {
-				DEBUG_PRINT("Error: Free list prev pointer at element %p points out of the heap!", current);
-				exit(1);
+			if(SLAB_IS_FULL(current) || current->used >= SLAB_SLOTS(class)) {
+				DEBUG_PRINT("Error: Full slab %p in slab list!", current);
+				return -1;
+			}
+			cnode* slot = current->free;
+			while(slot != NULL) {
+				if(SLAB_OF(slot) != current || (char*)slot >= current->bump ||
+						((char*)slot - (char*)current - SLAB_HDR_SIZE) % SLOT_SIZE(class) != 0) {
+					DEBUG_PRINT("Error: Free slot %p is not a slot of slab %p!", slot, current);
+					return -1;
+				}
+				slot = slot->next;
 			}
+			current = current->next;
+		}
+	}
 
-			current = current->next; // continue with next element...
+	// 6. Check the pending blocks
+	size_t pending = 0;
+	node* item;
+	for(item = (node*) tofree_listp; item != NULL; item = NEXT_FREE(item)) {
+		if(!IS_ALLOCATED(HDRP(item))) {
+			DEBUG_PRINT("Error: Free block %p in tofree list!", item);
+			return -1;
+		}
+		pending += GET_SIZE(HDRP(item));
+	}
+	int bin;
+	for(bin=0; bin<QUICK_BINS; bin++) {
+		if((quick_listp[bin] != 0) != ((quick_bitmap >> bin) & 1)) {
+			DEBUG_PRINT("Error: Bitmap is wrong for quick list %d!", bin);
+			return -1;
 		}
+		for(item = FROM_LINK(quick_listp[bin]); item != NULL; item = NEXT_FREE(item)) {
+			if(!IS_ALLOCATED(HDRP(item)) || QUICK_BIN(GET_SIZE(HDRP(item))) != bin) {
+				DEBUG_PRINT("Error: Block %p in wrong quick list %d!", item, bin);
+				return -1;
+			}
+			pending += GET_SIZE(HDRP(item));
+		}
+	}
+	if(pending != pending_size) {
+		DEBUG_PRINT("Error: %zu bytes are pending, not %zu!", pending, pending_size);
+		return -1;
 	}
 
 	// Now we walk through the whole heap and check some invariants for every block
-	char* current_block = (mem_heap_lo()+8); // exclude epilogue
+	char* current_block = NEXT_BLKP(heap_listp); // exclude prologue
+	size_t last_alloc = PREV_ALLOC; // prologue
 	while( ((void*)current_block) < mem_heap_hi() ) {
 		/*
 		printf("Current block is at address %p\n", current_block);
@@ -153,36 +585,55 @@ int mm_check() {
 		if(!IS_ALLOCATED(HDRP(current_block))) {
 
 			// 2. check if coalescing blocks is working (there is no free block with neighbouring free blocks)
-			size_t prev_alloc = IS_ALLOCATED(FTRP(PREV_BLKP(current_block)));
+			size_t prev_alloc = IS_PREV_ALLOCATED(HDRP(current_block));
 			size_t next_alloc = IS_ALLOCATED(HDRP(NEXT_BLKP(current_block)));
 			if(!next_alloc) {
 				DEBUG_PRINT("Error: Coalescing next block for %p failed!", current_block);
-				exit(1);
+				return -1;
 			}
 			if(!prev_alloc) {
 				DEBUG_PRINT("Error: Coalescing previous block for %p failed!", current_block);
-				exit(1);
+				return -1;
 			}
 
 			// 3. check that every free block is also in the free list
 			int block_found = 0;
-			if(free_listp != NULL) {
-				node* item = (node*) free_listp;
+			{
+				node* item = FROM_LINK(seg_listp[size_class(GET_SIZE(HDRP(current_block)))]);
 				while(item != NULL) {
 					if((char*)item == current_block)
 						block_found = 1;
-					item = item->next;
+					item = NEXT_FREE(item);
 				}
 			}
 			if(!block_found) {
 				DEBUG_PRINT("Error: Block %p is free but not in the free list!", current_block);
-				exit(1);
+				return -1;
 			}
+
+			// 4b. does the footer match the header?
+			if(GET_SIZE(FTRP(current_block)) != GET_SIZE(HDRP(current_block))) {
+				DEBUG_PRINT("Error: Header and footer of free block %p don't match!", current_block);
+				return -1;
+			}
+		}
+
+		// 4b. is the prev allocated bit right?
+		if(IS_PREV_ALLOCATED(HDRP(current_block)) != last_alloc) {
+			DEBUG_PRINT("Error: Wrong prev allocated bit in block %p!", current_block);
+			return -1;
 		}
+		last_alloc = IS_ALLOCATED(HDRP(current_block)) ? PREV_ALLOC : 0;
 
 		current_block = NEXT_BLKP(current_block);
 	}
 
+	// 4b. also for the epilogue
+	if(IS_PREV_ALLOCATED(HDRP(current_block)) != last_alloc) {
+		DEBUG_PRINT("Error: Wrong prev allocated bit in epilogue!");
+		return -1;
+	}
+
 
 	return 0;
 }
@@ -195,7 +646,7 @@ int mm_check() {
  */
 static void print_heap() {
 	int i = 0;
-	char* current_block = (mem_heap_lo()+8); // exclude epilogue
+	char* current_block = NEXT_BLKP(heap_listp); // exclude prologue
 	printf("start\n");
 	while( ((void*)current_block) < mem_heap_hi() ) {
 		printf("%d %d %d\n", i++, GET_SIZE(HDRP(current_block)), IS_ALLOCATED(HDRP(current_block)));
@@ -204,42 +655,231 @@ static void print_heap() {
 	printf("end\n");
 }
 
+/*
+ * mm_stats
+ *  - fills in *stats (see mm.h): walks the heap to get the bytes in
+ *    use, pending, in unused slab slots and free (by size), and copies
+ *    the event counters
+ *  - slots in the thread caches count as used
+ */
+void mm_stats(mm_stats_t* stats) {
+	char* bp;
+
+	pthread_mutex_lock(&heap_lock);
+	*stats = events;
+	stats->heap_size = mem_heapsize();
+	stats->mapped_size = mem_mapsize();
+	stats->pending_bytes = pending_size;
+
+	for(bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) != 0; bp = NEXT_BLKP(bp)) {
+		size_t size = GET_SIZE(HDRP(bp));
+
+		if(!IS_ALLOCATED(HDRP(bp))) {
+			stats->free_bytes += size;
+			stats->free_blocks++;
+			stats->free_bins[31 - __builtin_clz((unsigned int) size)] += size;
+			stats->largest_free = MAX(stats->largest_free, size);
+		} else if(slab_of(bp) == (slab*)bp) {
+			slab* s = (slab*)bp;
+			stats->used_bytes += s->used * SLOT_SIZE(s->class);
+			stats->slab_bytes += size - s->used * SLOT_SIZE(s->class);
+		} else {
+			stats->used_bytes += size; // pending blocks are marked allocated too
+		}
+	}
+	stats->used_bytes -= pending_size;
+	if(stats->free_bytes > 0)
+		stats->ext_frag = 1.0 - (double)stats->largest_free / stats->free_bytes;
+	pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * walk_slab
+ *  - reports a slab to a mm_walk callback in runs like mm_stats counts
+ *    it: the slots in use (cached ones included) as MM_BLOCK_USED, the
+ *    header and the freed and never used slots as MM_BLOCK_SLAB
+ *  note: heap_lock has to be held
+ */
+static void walk_slab(slab* s, mm_walk_fn fn, void* arg) {
+	char is_free[SLAB_SIZE / ALIGNMENT];
+	size_t slot_size = SLOT_SIZE(s->class);
+	char* slots = (char*)s + SLAB_HDR_SIZE;
+	char* end = HDRP(s) + GET_SIZE(HDRP(s));
+	char* start = HDRP(s);
+	int state = MM_BLOCK_SLAB;
+	int i, n = (s->bump - slots) / slot_size; // slots which have been used
+	cnode* slot;
+
+	memset(is_free, 0, n);
+	for(slot = s->free; slot != NULL; slot = slot->next)
+		is_free[((char*)slot - slots) / slot_size] = 1;
+
+	for(i = 0; i <= n; i++) {
+		int slot_state = (i < n && !is_free[i]) ? MM_BLOCK_USED : MM_BLOCK_SLAB;
+		char* bp = slots + i * slot_size;
+
+		if(slot_state != state) {
+			fn(arg, start, bp - start, state);
+			start = bp;
+			state = slot_state;
+		}
+	}
+	fn(arg, start, end - start, MM_BLOCK_SLAB);
+}
+
+/*
+ * mm_walk
+ *  - calls fn for every block of the heap (see mm.h): the state comes
+ *    from the boundary tags (and slab_map), slabs are split into runs
+ *    of used and unused slots (see walk_slab), then the pending blocks
+ *    of the tofree and quick lists are reported again
+ *  note: fn must not call the allocator, heap_lock is held
+ */
+void mm_walk(mm_walk_fn fn, void* arg) {
+	char* bp;
+	node* item;
+	int bin;
+
+	pthread_mutex_lock(&heap_lock);
+	for(bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) != 0; bp = NEXT_BLKP(bp)) {
+		if(IS_ALLOCATED(HDRP(bp)) && slab_of(bp) == (slab*)bp)
+			walk_slab((slab*)bp, fn, arg);
+		else
+			fn(arg, HDRP(bp), GET_SIZE(HDRP(bp)),
+					IS_ALLOCATED(HDRP(bp)) ? MM_BLOCK_USED : MM_BLOCK_FREE);
+	}
+
+	for(item = (node*) tofree_listp; item != NULL; item = NEXT_FREE(item))
+		fn(arg, HDRP(item), GET_SIZE(HDRP(item)), MM_BLOCK_PENDING);
+	for(bin = 0; bin < QUICK_BINS; bin++)
+		for(item = FROM_LINK(quick_listp[bin]); item != NULL; item = NEXT_FREE(item))
+			fn(arg, HDRP(item), GET_SIZE(HDRP(item)), MM_BLOCK_PENDING);
+	pthread_mutex_unlock(&heap_lock);
+}
+
+
+
+#if LIST_ORDER == ORDER_ADDRESS
+/*
+ * next_region
+ *  - finds the first region >= r in which list `class` has blocks
+ *  @return the region or -1 if there is none
+ */
+static int next_region(int class, unsigned int r) {
+	unsigned int w = r / 64;
+	uint64_t bits;
 
+	if(r >= REGIONS)
+		return -1;
+	bits = region_bitmap[class][w] & (~(uint64_t)0 << (r % 64));
+	while(bits == 0) {
+		if(++w == REGIONS / 64)
+			return -1;
+		bits = region_bitmap[class][w];
+	}
+	return w*64 + __builtin_ctzll(bits);
+}
+#endif
 
 /*
  * remove_from_free_list
  *  - removes element in free list
  *  - ensures pointers of next and prev element point to each other
+ *  note: the size in the header of bp is used to find the list,
+ *  so call this before changing the header
  */
 static void remove_from_list(void* bp) {
 	node* bpn = (node*) bp;
 
-	if(bpn->prev == NULL) {
-		free_listp = (void*) bpn->next;
+#if LIST_ORDER == ORDER_ADDRESS
+	int iclass = size_class(GET_SIZE(HDRP(bp)));
+	unsigned int r = REGION(bp);
+
+	if(region_head[iclass][r] == TO_LINK(bp)) {
+		if(bpn->next != 0 && REGION(NEXT_FREE(bpn)) == r)
+			region_head[iclass][r] = bpn->next;
+		else
+			region_bitmap[iclass][r / 64] &= ~((uint64_t)1 << (r % 64));
+	}
+	if(tail_listp[iclass] == TO_LINK(bp))
+		tail_listp[iclass] = bpn->prev;
+#endif
+
+	if(bpn->prev == 0) {
+		int class = size_class(GET_SIZE(HDRP(bp)));
+		seg_listp[class] = bpn->next;
+		if(bpn->next == 0) {
+			// the list is empty now
+			sl_bitmap[class / SL_COUNT] &= ~(1U << (class % SL_COUNT));
+			if(sl_bitmap[class / SL_COUNT] == 0)
+				fl_bitmap &= ~(1U << (class / SL_COUNT));
+		}
 	} else {
-		bpn->prev->next = bpn->next;
+		PREV_FREE(bpn)->next = bpn->next;
 	}
-	if(bpn->next != NULL) {
-		bpn->next->prev = bpn->prev;
+	if(bpn->next != 0) {
+		NEXT_FREE(bpn)->prev = bpn->prev;
 	}
 }
 
 /*
  * add_to_free_list
- *  - adds an element to free list
+ *  - adds an element to the free list of its size class
  *  - elements are always placed at the beginning
  */
 static void add_to_free_list(void* bp) {
 
-	node* old_first = (node*) free_listp;
+	int class = size_class(GET_SIZE(HDRP(bp)));
+	node* old_first = FROM_LINK(seg_listp[class]);
 	node* new_first = (node*) bp;
 
+#if LIST_ORDER == ORDER_ADDRESS
+	// insert behind the last block with a lower address (prev), the
+	// region index tells where to start looking for it
+	unsigned int r = REGION(bp);
+	node* prev;
+
+	if(HAS_REGION(class, r)) {
+		prev = FROM_LINK(region_head[class][r]);
+		if((char*)prev > (char*)bp) {
+			prev = PREV_FREE(prev); // in an earlier region (or NULL)
+			region_head[class][r] = TO_LINK(bp);
+		} else {
+			while(prev->next != 0 && (char*)NEXT_FREE(prev) < (char*)bp)
+				prev = NEXT_FREE(prev);
+		}
+	} else {
+		// bp is the only block of its region: in front of the next region
+		int next_r = next_region(class, r+1);
+		prev = (next_r >= 0) ? PREV_FREE(FROM_LINK(region_head[class][next_r])) :
+				FROM_LINK(tail_listp[class]);
+		region_head[class][r] = TO_LINK(bp);
+		region_bitmap[class][r / 64] |= (uint64_t)1 << (r % 64);
+	}
+
+	if(prev == NULL && old_first == NULL)
+		tail_listp[class] = TO_LINK(bp);
+	if(prev != NULL) {
+		new_first->next = prev->next;
+		new_first->prev = TO_LINK(prev);
+		if(prev->next != 0)
+			NEXT_FREE(prev)->prev = TO_LINK(new_first);
+		else
+			tail_listp[class] = TO_LINK(bp);
+		prev->next = TO_LINK(new_first);
+		return; // the list was not empty, the bitmaps are right
+	}
+#endif
+
 	if(old_first != NULL) {
-		old_first->prev = new_first;
+		old_first->prev = TO_LINK(new_first);
 	}
-	new_first->next = old_first;
-	new_first->prev = NULL;
-	free_listp = (void*) new_first;
+	new_first->next = TO_LINK(old_first);
+	new_first->prev = 0;
+	seg_listp[class] = TO_LINK(new_first);
+
+	sl_bitmap[class / SL_COUNT] |= 1U << (class % SL_COUNT);
+	fl_bitmap |= 1U << (class / SL_COUNT);
 
 }
 
@@ -255,10 +895,10 @@ static void add_to_tofree_list(void* bp) {
 	node* new_first = (node*) bp;
 
 	if(old_first != NULL) {
-		old_first->prev = new_first;
+		old_first->prev = TO_LINK(new_first);
 	}
-	new_first->next = old_first;
-	new_first->prev = NULL;
+	new_first->next = TO_LINK(old_first);
+	new_first->prev = 0;
 	tofree_listp = (void*) new_first;
 
 }
@@ -272,26 +912,72 @@ static void add_to_tofree_list(void* bp) {
 static void remove_from_tofree_list(void* bp) {
 	node* bpn = (node*) bp;
 
-	if(bpn->prev == NULL) {
-		tofree_listp = (void*) bpn->next;
+	if(bpn->prev == 0) {
+		tofree_listp = (void*) NEXT_FREE(bpn);
 	} else {
-		bpn->prev->next = bpn->next;
+		PREV_FREE(bpn)->next = bpn->next;
 	}
-	if(bpn->next != NULL) {
-		bpn->next->prev = bpn->prev;
+	if(bpn->next != 0) {
+		NEXT_FREE(bpn)->prev = bpn->prev;
 	}
 }
 
 
+/*
+ * quick_push
+ *  - puts a pending block in front of the quick list of its size
+ */
+static void quick_push(void* bp) {
+	int bin = QUICK_BIN(GET_SIZE(HDRP(bp)));
+
+	((node*) bp)->next = quick_listp[bin];
+	quick_listp[bin] = TO_LINK(bp);
+	quick_bitmap |= (uint64_t)1 << bin;
+}
+
+/*
+ * quick_pop
+ *  - takes the first block of a non empty quick list
+ */
+static void* quick_pop(int bin) {
+	node* bpn = FROM_LINK(quick_listp[bin]);
+
+	quick_listp[bin] = bpn->next;
+	if(bpn->next == 0)
+		quick_bitmap &= ~((uint64_t)1 << bin);
+	return bpn;
+}
+
+/*
+ * mark_allocated
+ *  - writes the header of an allocated block of `size` bytes at bp
+ *    and tells the next block that its previous block is allocated
+ */
+static void mark_allocated(void* bp, size_t size) {
+	PUT(HDRP(bp), PACK(size, IS_PREV_ALLOCATED(HDRP(bp)) | ALLOC));
+	PUT(HDRP(NEXT_BLKP(bp)), GET(HDRP(NEXT_BLKP(bp))) | PREV_ALLOC);
+}
+
+/*
+ * mark_free
+ *  - writes header and footer of a free block of `size` bytes at bp
+ *    and tells the next block that its previous block is free
+ */
+static void mark_free(void* bp, size_t size) {
+	PUT(HDRP(bp), PACK(size, IS_PREV_ALLOCATED(HDRP(bp))));
+	PUT(FTRP(bp), PACK(size, 0));
+	PUT(HDRP(NEXT_BLKP(bp)), GET(HDRP(NEXT_BLKP(bp))) & ~PREV_ALLOC);
+}
 
 /*
  * coalesce
- *  - merges adjacent free blocks together and removes them
- *    from the free list
+ *  - merges the free block bp (marked free, but not in any free list yet)
+ *    with adjacent free blocks and removes them from their free lists
+ *  - adds the merged block to the free list of its (new) size class
  *  @return pointer to the (probably new) beginning of the block
  */
 static void* coalesce(void* bp) {
-	size_t prev_alloc = IS_ALLOCATED(FTRP(PREV_BLKP(bp)));
+	size_t prev_alloc = IS_PREV_ALLOCATED(HDRP(bp));
 	size_t next_alloc = IS_ALLOCATED(HDRP(NEXT_BLKP(bp)));
 	size_t size = GET_SIZE(HDRP(bp));
 
@@ -299,26 +985,27 @@ static void* coalesce(void* bp) {
 		remove_from_list(NEXT_BLKP(bp));
 
 		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-		PUT(HDRP(bp), PACK(size, 0));
-		PUT(FTRP(bp), PACK(size, 0));
+		mark_free(bp, size);
+		events.coalesces++;
 	}
 	if(!prev_alloc) {
-		remove_from_list(bp);
+		remove_from_list(PREV_BLKP(bp));
+		events.coalesces++;
 
 		size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-		PUT(FTRP(bp), PACK(size, 0));
-		PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-
 		bp = PREV_BLKP(bp); // set bp pointer to beginning of prev block
+		mark_free(bp, size);
 	}
 
+	add_to_free_list(bp);
+
 	return bp;
 }
 
 /*
  * extend_heap
  *  - extends heap by words bytes
- *    note: words is aligned to be a multiple of WSIZE
+ *    note: words*WSIZE is rounded up to a multiple of ALIGNMENT
  *  - calls mem_sbrk
  *  @return a pointer to the allocated block, or NULL if no more space
  */
@@ -327,17 +1014,17 @@ static void* extend_heap(size_t words) {
 	char* bp;
 	size_t size;
 
-	/* Allocate an even number of words to maintain alignment */
-	size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+	/* Allocate a multiple of ALIGNMENT to maintain alignment */
+	size = ALIGN(words * WSIZE);
 
-	if( (int)(bp = mem_sbrk(size)) == -1 )
+	if( (bp = mem_sbrk(size)) == (void*)-1 )
 		return NULL;
+	events.extends++;
 
-	PUT(HDRP(bp), PACK(size, 0)); // free block header (note: old epiloge overwritten)
+	// free block header (note: old epiloge overwritten, it knows about the previous block)
+	PUT(HDRP(bp), PACK(size, IS_PREV_ALLOCATED(HDRP(bp))));
 	PUT(FTRP(bp), PACK(size, 0)); // free block footer
-	PUT(HDRP(NEXT_BLKP(bp)), PACK(0,1)); // new epilogue header
-
-	add_to_free_list(bp);
+	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC)); // new epilogue header
 
 	return coalesce(bp);
 }
@@ -346,8 +1033,11 @@ static void* extend_heap(size_t words) {
 /*
  * mm_init
  *   - initializes the malloc code
- *   - sets list pointers to null
+ *   - reserves the free list heads at the start of
+ *     the heap and sets them to null
  *   - allocates a chung of memory
+ *   note: this is not thread safe, no other thread may use the
+ *   allocator while mm_init runs
  *   - makes sure we always have a prologue header
  *     and epilogue footer block at the beginning
  *     and end of our heap, this makes coalescing
@@ -355,18 +1045,45 @@ static void* extend_heap(size_t words) {
  *   @return -1 on error (i.e. no space available), 0 on success
  */
 int mm_init() {
+	size_t seg_size = ALIGN(NUM_CLASSES*sizeof(unsigned int));
+	size_t bitmap_size = ALIGN(FL_COUNT*sizeof(unsigned char));
+	size_t heads_size = seg_size + bitmap_size + ALIGN(SLAB_CLASSES*sizeof(slab*));
+	int class;
 
-	if((heap_listp = (char*)mem_sbrk(4*WSIZE)) == NULL)
+	if((heap_listp = (char*)mem_sbrk(heads_size + 4*WSIZE)) == (void*)-1)
 		return -1;
 
-	free_listp = NULL;
+	heap_lo = heap_listp; // the list heads are at offset 0, so no block has link 0
+	seg_listp = (unsigned int*) heap_listp;
+	for(class=0; class<NUM_CLASSES; class++) {
+		seg_listp[class] = 0;
+	}
+	sl_bitmap = (unsigned char*) (heap_listp + seg_size);
+	memset(sl_bitmap, 0, FL_COUNT);
+	fl_bitmap = 0;
+#if LIST_ORDER == ORDER_ADDRESS
+	memset(region_bitmap, 0, sizeof(region_bitmap));
+	memset(tail_listp, 0, sizeof(tail_listp));
+#endif
+	slab_listp = (slab**) (heap_listp + seg_size + bitmap_size);
+	for(class=0; class<SLAB_CLASSES; class++) {
+		slab_listp[class] = NULL;
+	}
+	slab_base = (char*) SLAB_OF(mem_heap_lo());
+	memset(slab_map, 0, sizeof(slab_map));
+	heap_listp += heads_size;
 	tofree_listp = NULL;
+	memset(quick_listp, 0, sizeof(quick_listp));
+	quick_bitmap = 0;
+	pending_size = 0;
+	memset(&events, 0, sizeof(events));
+	heap_generation++; // slots in the thread caches are gone with the old heap
 
 	// set up empty heap
 	PUT(heap_listp, 0); /* alignment padding */
-	PUT(heap_listp+WSIZE, PACK(OVERHEAD, 1) ); /* prologue header */
-	PUT(heap_listp+DSIZE, PACK(OVERHEAD, 1) ); /* prologue footer */
-	PUT(heap_listp+WSIZE+DSIZE, PACK(0, 1)  ); /* epilogue header */
+	PUT(heap_listp+WSIZE, PACK(DSIZE, PREV_ALLOC | ALLOC) ); /* prologue header */
+	PUT(heap_listp+DSIZE, PACK(DSIZE, PREV_ALLOC | ALLOC) ); /* prologue footer */
+	PUT(heap_listp+WSIZE+DSIZE, PACK(0, PREV_ALLOC | ALLOC)  ); /* epilogue header */
 	heap_listp += DSIZE;
 
 	// extend empty heap with a free block of 1<<12 bytes
@@ -376,74 +1093,127 @@ int mm_init() {
 	return 0;
 }
 
+#if FIT_POLICY == FIT_GOOD
 /*
- * find_fit_first
- *  - uses first fit strategy
- *  - walks through free list search for block of at least `requested_size`
- *  @return pointer to first block in free list of at least `requested_size` bytes
- *  		or NULL if no such block exists or free list is empty
+ * find_fit_good
+ *  - uses good fit strategy
+ *  - tries the first FIT_SCAN_LIMIT blocks in the free list of the size
+ *    class of `requested_size` and takes the smallest which fits,
+ *    if there is none the first block of the next non empty (bigger)
+ *    class is taken (found with the bitmaps)
+ *  @return pointer to a block in free lists of at least `requested_size` bytes
+ *  		or NULL if no such block exists or free lists are empty
  */
-static void* find_fit_first(size_t requested_size) {
+static void* find_fit_good(size_t requested_size) {
+	int class = size_class(requested_size);
+	node* best_fitting_block = NULL;
+	node* current_bp = FROM_LINK(seg_listp[class]);
+	int tries;
+
+	// walk through (the start of) the list of this class
+	events.searches++;
+	for(tries=0; current_bp != NULL && tries<FIT_SCAN_LIMIT; tries++) {
+		size_t size = GET_SIZE(HDRP(current_bp));
+		events.search_steps++;
+		if(size == requested_size) {
+			return current_bp; // perfect match: return current_bp
+		}
+		if(size > requested_size && (best_fitting_block == NULL || size < GET_SIZE(HDRP(best_fitting_block)))) {
+			best_fitting_block = current_bp;
+		}
+		current_bp = NEXT_FREE(current_bp);
+	}
+	if(best_fitting_block != NULL)
+		return best_fitting_block;
+
+	// every block in a bigger class fits
+	if((class = next_class(class+1)) < 0)
+		return NULL;
+	return FROM_LINK(seg_listp[class]);
+}
+#endif
 
-	if(free_listp == NULL) { return NULL; }
 
-	node* current_bp = (node*) free_listp;
-	// walk through the whole list
-	while(current_bp != NULL) {
-		if(GET_SIZE(HDRP(current_bp)) >= requested_size) {
-			return current_bp;
+#if FIT_POLICY == FIT_FIRST
+/*
+ * find_fit_first
+ *  - uses first fit strategy: the first block of the lists of the size
+ *    class of `requested_size` and up which is big enough
+ *    (in lists of bigger classes this is the first block)
+ *  @return pointer to a block in free lists of at least `requested_size` bytes
+ *  		or NULL if no such block exists or free lists are empty
+ */
+static void* find_fit_first(size_t requested_size) {
+	int class;
+
+	events.searches++;
+	for(class=next_class(size_class(requested_size)); class>=0; class=next_class(class+1)) {
+		node* current_bp = FROM_LINK(seg_listp[class]);
+		while(current_bp != NULL) {
+			events.search_steps++;
+			if(GET_SIZE(HDRP(current_bp)) >= requested_size)
+				return current_bp;
+			current_bp = NEXT_FREE(current_bp);
 		}
-		current_bp = current_bp->next;
 	}
 	return NULL;
 }
+#endif
 
+#if FIT_POLICY == FIT_BEST
 /*
  * find_fit_best
- *  - uses best fit strategy
- *  - walks through free list searching for the block with |requested_size - size| minimal
- * @return block out of free list with requested_size-size minimal
- * 			or NULL if no such block exists or free list is empty
+ *  - uses best fit strategy: the smallest block of the size class of
+ *    `requested_size` which is big enough, if there is none the smallest
+ *    block of the next non empty class (scans both lists completely)
+ *  @return pointer to a block in free lists of at least `requested_size` bytes
+ *  		or NULL if no such block exists or free lists are empty
  */
 static void* find_fit_best(size_t requested_size) {
-	size_t best_fitting_size = 2147483647;
-	size_t* best_fitting_block = NULL;
-
-	if(free_listp == NULL) { return NULL; }
-
-	node* current_bp = (node*) free_listp;
-	// walk through the list
-	while(current_bp != NULL) {
-		if(GET_SIZE(HDRP(current_bp)) == requested_size) {
-			return current_bp; // perfect match: return current_bp
+	int class = next_class(size_class(requested_size));
+	node* best_fitting_block = NULL;
+	int lists;
+
+	events.searches++;
+	for(lists = 0; class >= 0 && lists < 2 && best_fitting_block == NULL; lists++) {
+		node* current_bp = FROM_LINK(seg_listp[class]);
+		while(current_bp != NULL) {
+			size_t size = GET_SIZE(HDRP(current_bp));
+			events.search_steps++;
+			if(size == requested_size)
+				return current_bp;
+			if(size > requested_size && (best_fitting_block == NULL || size < GET_SIZE(HDRP(best_fitting_block))))
+				best_fitting_block = current_bp;
+			current_bp = NEXT_FREE(current_bp);
 		}
-		if(GET_SIZE(HDRP(current_bp)) >= requested_size && GET_SIZE(HDRP(current_bp)) < best_fitting_size) {
-			// update best match we currently have
-			best_fitting_size = GET_SIZE(HDRP(current_bp));
-			best_fitting_block = (void*)current_bp;
-		}
-		current_bp = current_bp->next;
+		class = next_class(class+1);
 	}
 	return best_fitting_block;
 }
-
+#endif
 
 /*
  * find_fit
- *  - find_fit delegates to the find function
+ *  - find_fit delegates to the find function of FIT_POLICY
  *  note: this is just a helper function because we call
  *  find_fit from multiple locations
  */
 static void* find_fit(size_t requested_size) {
+#if FIT_POLICY == FIT_FIRST
 	return find_fit_first(requested_size);
+#elif FIT_POLICY == FIT_BEST
+	return find_fit_best(requested_size);
+#else
+	return find_fit_good(requested_size);
+#endif
 }
 
 
 /*
  * place
  *  - places requested block size
- *  - splits into two halfs if the block is
- *    larger than OVERHEAD+DSIZE (i.e. 16 Bytes)
+ *  - splits into two halfs if the remainder is
+ *    at least SPLIT_THRESHOLD (MIN_BLOCK_SIZE by default)
  *    and adds the second half to the free list
  *  - bp is marked as used and removed from free list
  *
@@ -454,22 +1224,22 @@ static void* place(void *bp, size_t asize) {
 	size_t blk_size = GET_SIZE(HDRP(bp));
 	size_t remainder = blk_size - asize;
 
-	if(remainder >= (OVERHEAD+DSIZE)) {
+	remove_from_list(bp);
+
+	if(remainder >= SPLIT_THRESHOLD) {
 		// split
-		PUT(HDRP(bp), PACK(asize, 1));
-		PUT(FTRP(bp), PACK(asize, 1));
+		PUT(HDRP(bp), PACK(asize, IS_PREV_ALLOCATED(HDRP(bp)) | ALLOC));
 		new_block = NEXT_BLKP(bp);
-		PUT(HDRP(new_block), PACK(remainder, 0));
+		PUT(HDRP(new_block), PACK(remainder, PREV_ALLOC));
 		PUT(FTRP(new_block), PACK(remainder, 0));
 
 		add_to_free_list(new_block);
+		events.splits++;
 	}
 	else {
 		// keep overhead
-		PUT(HDRP(bp), PACK(blk_size, 1));
-		PUT(FTRP(bp), PACK(blk_size, 1));
+		mark_allocated(bp, blk_size);
 	}
-	remove_from_list(bp);
 
 	return bp;
 }
@@ -477,60 +1247,193 @@ static void* place(void *bp, size_t asize) {
 
 
 /*
- * mm_malloc
- *  - Allocate a block of `size` bytes
- *  - If there is no space, we free the blocks in to_free list
- *    and try again.
- *  note: this function is used by clients
- *  @return pointer to the newly allocated block
+ * aligned_fit
+ *  - checks if an `asize` bytes block with an `align` aligned block pointer
+ *    can be placed in the free block bp, the part in front of the aligned
+ *    block has to be big enough to become a free block of its own
+ *  @return the aligned block pointer or NULL if it doesn't fit
  */
-void* mm_malloc(size_t size) {
-	//mm_check();
-	//print_heap();
-	/*if(size <= 0)
-		return NULL;*/
+static char* aligned_fit(void* bp, size_t asize, size_t align) {
+	char* abp = (char*) (((uintptr_t)bp + align-1) & ~(uintptr_t)(align-1));
 
-	size_t asize;
-	size_t extendsize;
+	if(abp != (char*)bp && abp - (char*)bp < MIN_BLOCK_SIZE)
+		abp += align;
+	if(abp - (char*)bp + asize > GET_SIZE(HDRP(bp)))
+		return NULL;
 
-	char* bp;
+	return abp;
+}
+
+/*
+ * find_fit_aligned
+ *  - good fit for a block of `asize` bytes with an `align` aligned
+ *    block pointer (see aligned_fit): we try the first FIT_SCAN_LIMIT
+ *    blocks of the classes of `asize` and up, then take the first block
+ *    of a class whose blocks have room for the request behind any lead
+ *  @return free block which can hold the aligned block or NULL
+ */
+static void* find_fit_aligned(size_t asize, size_t align) {
+	int class, tries = 0;
+
+	events.searches++;
+	for(class=next_class(size_class(asize)); class>=0 && tries<FIT_SCAN_LIMIT; class=next_class(class+1)) {
+		node* current_bp = FROM_LINK(seg_listp[class]);
+		for(; current_bp != NULL && tries<FIT_SCAN_LIMIT; tries++) {
+			events.search_steps++;
+			if(aligned_fit(current_bp, asize, align) != NULL) {
+				return current_bp;
+			}
+			current_bp = NEXT_FREE(current_bp);
+		}
+	}
+
+	// the lead is shorter than align + MIN_BLOCK_SIZE
+	if((class = next_class(size_class(asize + align + MIN_BLOCK_SIZE) + 1)) < 0)
+		return NULL;
+	return FROM_LINK(seg_listp[class]);
+}
+
+/*
+ * place_aligned
+ *  - like place, but the block starts at the aligned block pointer abp
+ *    inside the free block bp (as returned by aligned_fit)
+ *  - the part in front of abp stays free and is added to the free list
+ *  @returns abp
+ */
+static void* place_aligned(void* bp, char* abp, size_t asize) {
+	if(abp != (char*)bp) {
+		size_t lead = abp - (char*)bp;
+		size_t rest = GET_SIZE(HDRP(bp)) - lead;
+
+		remove_from_list(bp);
+		PUT(HDRP(bp), PACK(lead, IS_PREV_ALLOCATED(HDRP(bp))));
+		PUT(FTRP(bp), PACK(lead, 0));
+		add_to_free_list(bp);
+
+		PUT(HDRP(abp), PACK(rest, 0)); // previous block (lead) is free
+		PUT(FTRP(abp), PACK(rest, 0));
+		add_to_free_list(abp);
+		events.splits++;
+	}
+
+	return place(abp, asize);
+}
 
-	// make sure we always have 8 bytes for free list...
+
+/*
+ * adjust_size
+ *  - computes the block size for a request of `size` payload bytes
+ *    (including OVERHEAD and alignment)
+ */
+static size_t adjust_size(size_t size) {
+	// make sure we always have room for the free list pointers...
 	if(size == 112) size = 128;
 	if(size == 448) size = 512;
-	if(size <= DSIZE) {
-		asize = DSIZE + OVERHEAD;
+	if(size + OVERHEAD <= MIN_BLOCK_SIZE) {
+		return MIN_BLOCK_SIZE;
 	} else {
-		asize = ALIGN(size+OVERHEAD);
+		return ALIGN(size+OVERHEAD);
 	}
+}
 
-	// Search free list for a fit
-	if( (bp = find_fit(asize)) != NULL ) {
-		place(bp, asize);
-		return bp;
-	} else if(tofree_listp != NULL) { // No space found but we can still free some space...
+/*
+ * trim_heap
+ *  - shrinks the heap if the last block is free and at least
+ *    TRIM_THRESHOLD bytes, CHUNKSIZE bytes of it are kept
+ *  note: heap_lock has to be held
+ */
+static void trim_heap() {
+	char* end = (char*)mem_heap_hi() + 1;
+	char* bp;
+	size_t size;
+
+	if(IS_PREV_ALLOCATED(end - WSIZE)) // epilogue header: is the last block free?
+		return;
+	size = GET_SIZE(end - DSIZE); // footer of the last block
+	if(size < TRIM_THRESHOLD)
+		return;
+
+	bp = end - size;
+	remove_from_list(bp);
+	if(mem_sbrk(-(int)(size - CHUNKSIZE)) == (void*)-1) {
+		add_to_free_list(bp);
+		return;
+	}
+	mark_free(bp, CHUNKSIZE);
+	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC)); // new epilogue header
+	add_to_free_list(bp);
+	events.trims++;
+}
+
+/*
+ * free_block
+ *  - Reset header, footer tags of the allocated block bp and call coalesce
+ *  - gives the pages of blocks of at least RELEASE_THRESHOLD bytes back
+ *    to the system (we only read the free list node and the footer of
+ *    a free block)
+ *  note: heap_lock has to be held
+ */
+static void free_block(void* bp) {
+	size_t size = GET_SIZE(HDRP(bp));
 
-		// Do lazy free: Reset header, footer tags, call coalesce
-		while(tofree_listp != NULL) {
-			void* bp = tofree_listp;
+	mark_free(bp, size);
+	if(size >= RELEASE_THRESHOLD)
+		mem_release((char*)bp + sizeof(node), size - sizeof(node) - DSIZE);
 
+	coalesce(bp);
+}
+
+/*
+ * coalesce_pending
+ *  - Do lazy free: free_block for up to `count` pending blocks,
+ *    the tofree list comes first, then the quick lists
+ *  - trims the heap
+ *  note: heap_lock has to be held
+ */
+static void coalesce_pending(int count) {
+	for(; count > 0 && pending_size > 0; count--) {
+		void* bp = tofree_listp;
+
+		if(bp != NULL)
 			remove_from_tofree_list(bp);
-			size_t csize = GET_SIZE(HDRP(bp));
+		else
+			bp = quick_pop(__builtin_ctzll(quick_bitmap));
 
-			PUT(HDRP(bp), PACK(csize, 0));
-			PUT(FTRP(bp), PACK(csize, 0));
+		pending_size -= GET_SIZE(HDRP(bp));
+		free_block(bp);
+	}
+	trim_heap();
+}
 
-			add_to_free_list(bp);
-			coalesce(bp);
+/*
+ * heap_malloc
+ *  - Allocate a block of `asize` bytes from the heap
+ *  - A pending block of the same size in the quick lists is reused
+ *  - If there is no space, we coalesce pending blocks (a batch at
+ *    a time, at most MISS_COALESCE_LIMIT) and try again.
+ *  note: heap_lock has to be held
+ *  @return pointer to the newly allocated block
+ */
+static void* heap_malloc(size_t asize) {
+	size_t extendsize;
+	char* bp;
+	int coalesced;
 
-		}
+	if(asize <= QUICK_MAX_SIZE && quick_listp[QUICK_BIN(asize)] != 0) {
+		bp = quick_pop(QUICK_BIN(asize));
+		pending_size -= asize;
+		PUT(HDRP(bp), GET(HDRP(bp)) & ~REALLOC_TAG); // still marked allocated
+		return bp;
+	}
 
-		// and try again...
-		if( (bp = find_fit(asize)) != NULL ) {
-			place(bp, asize);
-			return bp;
-		}
+	// Search free list for a fit, if there is none we can still free some space...
+	for(coalesced = 0; (bp = find_fit(asize)) == NULL && pending_size > 0 &&
+			coalesced < MISS_COALESCE_LIMIT; coalesced += COALESCE_BATCH)
+		coalesce_pending(COALESCE_BATCH);
 
+	if(bp != NULL) {
+		place(bp, asize);
+		return bp;
 	}
 
 	// No fit found, Get more memory and place block
@@ -543,93 +1446,874 @@ void* mm_malloc(size_t size) {
 }
 
 /*
- * mm_free
- *  - Is implemented lazy, we just add the blocks in the tofree_list.
+ * heap_malloc_aligned
+ *  - Allocate a block of `asize` bytes from the heap whose block
+ *    pointer is a multiple of `align` (a power of two)
+ *  - works like heap_malloc, if we have to extend the heap we
+ *    take just enough memory to place the block aligned at the end
+ *    of the heap (including the last block if it is free)
+ *  note: heap_lock has to be held
+ *  @return pointer to the newly allocated block
  */
-void mm_free(void *bp) {
-	add_to_tofree_list(bp);
-}
+static void* heap_malloc_aligned(size_t asize, size_t align) {
+	char* bp;
+	int coalesced;
+
+	for(coalesced = 0; (bp = find_fit_aligned(asize, align)) == NULL && pending_size > 0 &&
+			coalesced < MISS_COALESCE_LIMIT; coalesced += COALESCE_BATCH)
+		coalesce_pending(COALESCE_BATCH);
+
+	if(bp == NULL) {
+		char* end = (char*)mem_heap_hi() + 1; // block pointer of the new memory
+		char* start = end; // block pointer of the block extend_heap will return
+		char* abp;
+
+		if(!IS_PREV_ALLOCATED(end - WSIZE)) // epilogue header: is the last block free?
+			start -= GET_SIZE(end - DSIZE); // footer of the last block
+		abp = (char*) (((uintptr_t)start + align-1) & ~(uintptr_t)(align-1));
+		if(abp != start && abp - start < MIN_BLOCK_SIZE)
+			abp += align;
+
+		if((bp = extend_heap(MAX(abp + asize - end, CHUNKSIZE)/WSIZE)) == NULL)
+			return NULL;
+	}
+
+	return place_aligned(bp, aligned_fit(bp, asize, align), asize);
+}
+
+/*
+ * heap_malloc_batch
+ *  - Allocate `n` blocks of `asize` bytes from the heap into out
+ *  - pending blocks of the same size in the quick lists are taken first,
+ *    the rest is carved out of blocks of up to BATCH_MAX_SIZE bytes from
+ *    heap_malloc: the first blocks get `asize` bytes, the last one what
+ *    place left over
+ *  note: heap_lock has to be held
+ *  @return the number of blocks allocated, less than n if there is no more space
+ */
+static size_t heap_malloc_batch(size_t asize, size_t n, void** out) {
+	size_t i = 0;
+
+	while(i < n) {
+		size_t count = MIN(n - i, BATCH_MAX_SIZE / asize);
+		size_t last;
+		char* bp;
+
+		if(count <= 1 || (asize <= QUICK_MAX_SIZE && quick_listp[QUICK_BIN(asize)] != 0)) {
+			if((out[i] = heap_malloc(asize)) == NULL)
+				break;
+			i++;
+			continue;
+		}
+
+		if((bp = heap_malloc(count * asize)) == NULL)
+			break;
+		last = GET_SIZE(HDRP(bp)) - (count-1) * asize;
+		PUT(HDRP(bp), PACK(asize, IS_PREV_ALLOCATED(HDRP(bp)) | ALLOC));
+		for(; count > 1; count--) {
+			out[i++] = bp;
+			bp += asize;
+			PUT(HDRP(bp), PACK(count > 2 ? asize : last, PREV_ALLOC | ALLOC));
+			events.splits++;
+		}
+		out[i++] = bp;
+	}
+
+	return i;
+}
+
+/*
+ * heap_free
+ *  - Is implemented lazy, we just add the block to a quick list
+ *    or the tofree_list.
+ *  - if too much of the heap is pending, a batch of pending blocks
+ *    is coalesced
+ *  - with COALESCE_IMMEDIATE the block is coalesced right away
+ *  note: heap_lock has to be held
+ */
+static void heap_free(void *bp) {
+	size_t size = GET_SIZE(HDRP(bp));
+
+#if COALESCE_MODE == COALESCE_IMMEDIATE
+	free_block(bp);
+	trim_heap();
+	return;
+#endif
+
+	if(size <= QUICK_MAX_SIZE)
+		quick_push(bp);
+	else
+		add_to_tofree_list(bp);
+
+	pending_size += size;
+	if(pending_size > mem_heapsize() / PENDING_RATIO)
+		coalesce_pending(COALESCE_BATCH);
+}
+
+/*
+ * slab_link
+ *  - puts a slab in front of the slab list of its class
+ *  note: heap_lock has to be held
+ */
+static void slab_link(slab* s) {
+	s->prev = NULL;
+	s->next = slab_listp[s->class];
+	if(s->next != NULL)
+		s->next->prev = s;
+	slab_listp[s->class] = s;
+}
+
+/*
+ * slab_create
+ *  - gets a new slab for `class` from the heap and puts it
+ *    in front of the slab list of the class
+ *  note: heap_lock has to be held
+ *  @return the new slab or NULL if there is no more space
+ */
+static slab* slab_create(int class) {
+	slab* s = heap_malloc_aligned(SLAB_SIZE, SLAB_SIZE);
+
+	if(s == NULL)
+		return NULL;
+
+	s->free = NULL;
+	s->bump = (char*)s + SLAB_HDR_SIZE;
+	s->class = class;
+	s->used = 0;
+	slab_map[((char*)s - slab_base) / SLAB_SIZE] = 1;
+	slab_link(s);
+
+	return s;
+}
+
+/*
+ * slab_unlink
+ *  - removes a slab from the slab list of its class
+ *  note: heap_lock has to be held
+ */
+static void slab_unlink(slab* s) {
+	if(s->prev == NULL) {
+		slab_listp[s->class] = s->next;
+	} else {
+		s->prev->next = s->next;
+	}
+	if(s->next != NULL) {
+		s->next->prev = s->prev;
+	}
+}
+
+/*
+ * slab_alloc
+ *  - takes a slot out of the first slab of `class` which has free slots,
+ *    freed slots are reused first, then the slab is filled up from the bump pointer
+ *  - full slabs are removed from the slab list
+ *  note: heap_lock has to be held
+ *  @return pointer to the slot or NULL if there is no more space
+ */
+static void* slab_alloc(int class) {
+	slab* s = slab_listp[class];
+	void* bp;
+
+	if(s == NULL && (s = slab_create(class)) == NULL)
+		return NULL;
+
+	if(s->free != NULL) {
+		bp = s->free;
+		s->free = s->free->next;
+	} else {
+		bp = s->bump;
+		s->bump += SLOT_SIZE(class);
+	}
+	s->used++;
+
+	if(SLAB_IS_FULL(s))
+		slab_unlink(s);
+
+	return bp;
+}
+
+/*
+ * slab_free
+ *  - gives a slot back to its slab
+ *  - a full slab gets back into the slab list, an empty one
+ *    goes back to the heap unless it is the last one of its class
+ *  note: heap_lock has to be held
+ */
+static void slab_free(void* bp) {
+	slab* s = SLAB_OF(bp);
+	int was_full = SLAB_IS_FULL(s);
+	cnode* slot = (cnode*) bp;
+
+	slot->next = s->free;
+	s->free = slot;
+	s->used--;
+
+	if(was_full) {
+		slab_link(s);
+	} else if(s->used == 0 && (s->prev != NULL || s->next != NULL)) {
+		slab_unlink(s);
+		slab_map[((char*)s - slab_base) / SLAB_SIZE] = 0;
+		heap_free(s);
+	}
+}
+
+/*
+ * grow_in_place
+ *  - grows the allocated block bp to `asize` bytes if the next
+ *    block is free and big enough, a big enough rest is split off
+ *  - if bp (or the free block after it) is the last block of the heap,
+ *    the heap is extended by the missing bytes first
+ *  note: heap_lock has to be held
+ *  @return 1 if bp is now at least `asize` bytes, 0 otherwise
+ */
+static int grow_in_place(void* bp, size_t asize) {
+	size_t size = GET_SIZE(HDRP(bp));
+	char* next_bp = NEXT_BLKP(bp);
+	size_t next_size = 0;
+
+	if(!IS_ALLOCATED(HDRP(next_bp))) {
+		next_size = GET_SIZE(HDRP(next_bp));
+		if(size + next_size < asize && GET_SIZE(HDRP(NEXT_BLKP(next_bp))) == 0) {
+			// next block is the last one, extend it (coalesce merges the new memory)
+			if(extend_heap(MAX(asize - size - next_size, MIN_BLOCK_SIZE)/WSIZE) == NULL)
+				return 0;
+			next_size = GET_SIZE(HDRP(next_bp));
+		}
+	} else if(GET_SIZE(HDRP(next_bp)) == 0) {
+		// bp is the last block, get a free block after it
+		if((next_bp = extend_heap(MAX(asize - size, MIN_BLOCK_SIZE)/WSIZE)) == NULL)
+			return 0;
+		next_size = GET_SIZE(HDRP(next_bp));
+	}
+
+	if(size + next_size < asize)
+		return 0;
+
+	remove_from_list(next_bp);
+	if(size + next_size - asize >= SPLIT_THRESHOLD) {
+		// split, the rest stays free
+		char* rest;
+		PUT(HDRP(bp), PACK(asize, GET(HDRP(bp)) & (PREV_ALLOC | REALLOC_TAG) ) | ALLOC);
+		rest = NEXT_BLKP(bp);
+		PUT(HDRP(rest), PACK(size + next_size - asize, PREV_ALLOC));
+		PUT(FTRP(rest), PACK(size + next_size - asize, 0));
+		add_to_free_list(rest);
+		events.splits++;
+	} else {
+		PUT(HDRP(bp), PACK(size + next_size, GET(HDRP(bp)) & (PREV_ALLOC | REALLOC_TAG)) | ALLOC);
+		PUT(HDRP(NEXT_BLKP(bp)), GET(HDRP(NEXT_BLKP(bp))) | PREV_ALLOC);
+	}
+
+	return 1;
+}
+
+/*
+ * mmap_malloc
+ *  - allocates a block for `size` payload bytes in a mapping of its own
+ *  @return pointer to the block or NULL if there is no more space
+ */
+static void* mmap_malloc(size_t size) {
+	size_t map_size = MAP_SIZE(size);
+	char* bp = mem_map(map_size);
+
+	if(bp == (void*)-1)
+		return NULL;
+
+	bp += MMAP_OVERHEAD;
+	MAPPED_SIZE(bp) = map_size;
+	PUT(HDRP(bp), PACK(0, ALLOC));
+	return bp;
+}
+
+/*
+ * mmap_free
+ *  - unmaps a mapped block
+ */
+static void mmap_free(void* bp) {
+	mem_unmap((char*)bp - MMAP_OVERHEAD);
+}
+
+/*
+ * mmap_realloc
+ *  - resizes the mapping of a mapped block, the system moves the
+ *    pages if it can't grow it where it is (the block stays mapped
+ *    even if it gets smaller than MMAP_THRESHOLD)
+ *  @return pointer to the block or NULL if there is no more space
+ */
+static void* mmap_realloc(void* bp, size_t size) {
+	size_t map_size = MAP_SIZE(size);
+	char* new_bp;
+
+	if(map_size == MAPPED_SIZE(bp))
+		return bp;
+	if((new_bp = mem_remap((char*)bp - MMAP_OVERHEAD, map_size)) == (void*)-1)
+		return NULL;
+
+	new_bp += MMAP_OVERHEAD;
+	MAPPED_SIZE(new_bp) = map_size;
+	return new_bp;
+}
+
+/*
+ * tcache_push
+ *  - puts a slot into a bin of the cache of this thread
+ */
+static void tcache_push(int bin, void* bp) {
+	cnode* cbp = (cnode*) bp;
+
+	cbp->next = tcache.bins[bin];
+	tcache.bins[bin] = cbp;
+	tcache.counts[bin]++;
+}
+
+/*
+ * tcache_pop
+ *  - takes the first slot out of a (non empty) bin of the cache of this thread
+ */
+static void* tcache_pop(int bin) {
+	cnode* cbp = tcache.bins[bin];
+
+	tcache.bins[bin] = cbp->next;
+	tcache.counts[bin]--;
+
+	return cbp;
+}
+
+/*
+ * tcache_flush
+ *  - gives `count` slots of bin back to their slabs
+ *  note: heap_lock has to be held
+ */
+static void tcache_flush(int bin, int count) {
+	while(count-- > 0 && tcache.bins[bin] != NULL) {
+		slab_free(tcache_pop(bin));
+	}
+}
+
+/*
+ * tcache_destroy
+ *  - gives all slots in the cache of an exiting thread back to their slabs
+ */
+static void tcache_destroy(void* cache) {
+	int bin;
+
+	pthread_mutex_lock(&heap_lock);
+	if(tcache.generation == heap_generation) {
+		for(bin=0; bin<TCACHE_BINS; bin++) {
+			tcache_flush(bin, tcache.counts[bin]);
+		}
+	}
+	pthread_mutex_unlock(&heap_lock);
+}
+
+static void tcache_create_key() {
+	pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/*
+ * tcache_validate
+ *  - makes sure the cache of this thread belongs to the current heap,
+ *    if mm_init has been called in the mean time the cached slots are dropped
+ */
+static void tcache_validate() {
+	if(tcache.generation != heap_generation) {
+		memset(&tcache, 0, sizeof(tcache));
+		tcache.generation = heap_generation;
+
+		pthread_once(&tcache_key_once, tcache_create_key);
+		pthread_setspecific(tcache_key, &tcache); // non NULL, so tcache_destroy gets called
+	}
+}
+
+/*
+ * tcache_free
+ *  - puts a slot into a bin of the cache of this thread, if the bin
+ *    is full TCACHE_BATCH slots of it go back to their slabs first
+ */
+static void tcache_free(int bin, void* bp) {
+	tcache_validate();
+
+	if(tcache.counts[bin] >= TCACHE_MAX_COUNT) {
+		pthread_mutex_lock(&heap_lock);
+		tcache_flush(bin, TCACHE_BATCH);
+		pthread_mutex_unlock(&heap_lock);
+	}
+
+	tcache_push(bin, bp);
+}
+
+/*
+ * block_free
+ *  - frees a block which is not a slot: mapped blocks are unmapped,
+ *    heap blocks go to heap_free
+ */
+static void block_free(void* bp) {
+	// the header of a heap block can change under us (see mm_realloc)
+	pthread_mutex_lock(&heap_lock);
+	if(IS_MAPPED(bp)) {
+		pthread_mutex_unlock(&heap_lock);
+		mmap_free(bp);
+		return;
+	}
+	heap_free(bp);
+	pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * mm_malloc
+ *  - Allocate a block of `size` bytes
+ *  - Small blocks are slots which come from the thread cache, if the bin
+ *    is empty we refill it with TCACHE_BATCH slots from the slabs.
+ *  note: this function is used by clients
+ *  @return pointer to the newly allocated block
+ */
+void* mm_malloc(size_t size) {
+	//mm_check();
+	//print_heap();
+	/*if(size <= 0)
+		return NULL;*/
+
+	void* bp;
+
+	if(size <= SLAB_MAX_SIZE) {
+		int bin = SLAB_CLASS(size);
+		tcache_validate();
+
+		if(tcache.bins[bin] != NULL)
+			return tcache_pop(bin);
+
+		// refill: one slot for the caller plus TCACHE_BATCH-1 for later
+		int i;
+		pthread_mutex_lock(&heap_lock);
+		bp = slab_alloc(bin);
+		for(i=1; bp != NULL && i<TCACHE_BATCH; i++) {
+			void* cbp = slab_alloc(bin);
+			if(cbp == NULL)
+				break;
+			tcache_push(bin, cbp);
+		}
+		pthread_mutex_unlock(&heap_lock);
+
+		return bp;
+	}
+
+	if(size >= MMAP_THRESHOLD)
+		return mmap_malloc(size);
+
+	pthread_mutex_lock(&heap_lock);
+	bp = heap_malloc(adjust_size(size));
+	pthread_mutex_unlock(&heap_lock);
+
+	return bp;
+}
+
+/*
+ * mm_free
+ *  - Slots go into the thread cache, if the bin is full
+ *    TCACHE_BATCH slots of it go back to their slabs.
+ *  - Mapped blocks are unmapped.
+ *  - Everything else goes to the heap, where freeing is implemented
+ *    lazy, (see heap_free).
+ */
+void mm_free(void *bp) {
+	slab* s = slab_of(bp);
+
+	if(s != NULL) {
+		tcache_free(s->class, bp);
+		return;
+	}
+
+	block_free(bp);
+}
 
 /*
  * mm_realloc
+ *  - A slot is kept if it is big enough, otherwise it is moved with
+ *    malloc, memcpy and free
+ *  - A mapped block is resized with mmap_realloc, a block which gets
+ *    MMAP_THRESHOLD bytes or more is moved to a mapping
  *  - If the size of current block is bigger than requested size, we just return
  *    the Current block
- *  - Checks if left and right block is free and coalesces them
+ *  - Tries to grow the block in place (see grow_in_place), first without
+ *    and then after coalescing up to MISS_COALESCE_LIMIT pending blocks
+ *  - Checks if left (and right) block is free and coalesces them
  *  - If the space is big enough them we just move the data at the beginning
- *    of the prev block (if it was free) and return the new block.
+ *    of the prev block and return the new block.
  *  - Backup strategy: We use malloc, free and memcpy to allocate a new block
+ *  - A block which has to move gets REALLOC_RESERVE extra bytes if it has
+ *    been grown by realloc before
  *
  *  @return pointer to a block of size `size`, which contains the data of bp.
  */
 void* mm_realloc(void* bp, size_t size) {
 	void* new_location;
+	slab* s = slab_of(bp);
+
+	if(s != NULL) {
+		// slots can't grow, move the data to a block of the right size
+		size_t slot_size = SLOT_SIZE(s->class);
+		if(size <= slot_size)
+			return bp;
+
+		new_location = mm_malloc(size);
+		if(new_location != NULL) {
+			memcpy(new_location, bp, slot_size);
+			mm_free(bp);
+		}
+		return new_location;
+	}
+
+	// the header holds the prev allocated bit which other threads
+	// change when they (de)allocate the block before bp
+	pthread_mutex_lock(&heap_lock);
+
+	if(IS_MAPPED(bp)) {
+		pthread_mutex_unlock(&heap_lock);
+		return mmap_realloc(bp, size);
+	}
+
 	size_t copy_size = GET_SIZE(HDRP(bp)) - OVERHEAD;
+	size_t asize = adjust_size(size);
 
-	if(copy_size > size)
+	if(copy_size >= size) {
+		pthread_mutex_unlock(&heap_lock);
 		return bp; // no need to allocate a new block
+	}
 
-	// free lazy to_free list first
-	while(tofree_listp != NULL) {
-		void* bpa = tofree_listp;
+	if(size >= MMAP_THRESHOLD) {
+		new_location = mmap_malloc(size);
+		if(new_location != NULL) {
+			memcpy(new_location, bp, copy_size);
+			heap_free(bp);
+		}
+		pthread_mutex_unlock(&heap_lock);
+		return new_location;
+	}
 
-		remove_from_tofree_list(bpa);
-		size_t sizec = GET_SIZE(HDRP(bpa));
+	// grow forward (or at the end of the heap), pending blocks
+	// are only coalesced if they can help
+	if(grow_in_place(bp, asize) ||
+			(pending_size > 0 && (coalesce_pending(MISS_COALESCE_LIMIT), grow_in_place(bp, asize)))) {
+		PUT(HDRP(bp), GET(HDRP(bp)) | REALLOC_TAG);
+		pthread_mutex_unlock(&heap_lock);
+		return bp;
+	}
 
-		PUT(HDRP(bpa), PACK(sizec, 0));
-		PUT(FTRP(bpa), PACK(sizec, 0));
+	// the block has to move, give it some room if it keeps growing
+	if(IS_REALLOC_TAGGED(HDRP(bp)))
+		asize += REALLOC_RESERVE(asize);
 
-		add_to_free_list(bpa);
-		coalesce(bpa);
-	}
+	// check if we can coalesce with the previous (and next) block
+	if(!IS_PREV_ALLOCATED(HDRP(bp))) {
+		// the copy may overwrite the footer PREV_BLKP needs, so get it first
+		void* prev_bp = PREV_BLKP(bp);
+		void* next_bp = NEXT_BLKP(bp);
+		size_t size_cur = GET_SIZE(HDRP(prev_bp)) + GET_SIZE(HDRP(bp));
 
-	// check if we can coalesce neighboring blocks
-	size_t prev_alloc = IS_ALLOCATED(FTRP(PREV_BLKP(bp)));
-	size_t next_alloc = IS_ALLOCATED(HDRP(NEXT_BLKP(bp)));
-	size_t size_cur = GET_SIZE(HDRP(bp));
-	if(!next_alloc) {
-		remove_from_list(NEXT_BLKP(bp));
+		if(!IS_ALLOCATED(HDRP(next_bp)))
+			size_cur += GET_SIZE(HDRP(next_bp));
+
+		if(size_cur >= asize) {
+			remove_from_list(prev_bp);
+			if(!IS_ALLOCATED(HDRP(next_bp)))
+				remove_from_list(next_bp);
+			mark_allocated(prev_bp, size_cur);
 
-		size_cur += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-		PUT(HDRP(bp), PACK(size_cur, 1));
-		PUT(FTRP(bp), PACK(size_cur, 1));
+			// copy data one block down (the regions may overlap)
+			memmove(prev_bp, bp, copy_size);
+			PUT(HDRP(prev_bp), GET(HDRP(prev_bp)) | REALLOC_TAG);
+
+			pthread_mutex_unlock(&heap_lock);
+			return prev_bp;
+		}
 	}
-	if(!prev_alloc) {
-		remove_from_list(PREV_BLKP(bp));
 
-		size_cur += GET_SIZE(HDRP(PREV_BLKP(bp)));
-		PUT(FTRP(bp), PACK(size_cur, 1));
-		PUT(HDRP(PREV_BLKP(bp)), PACK(size_cur, 1));
+	// Backup plan: We do reallocation with malloc...
+	new_location = heap_malloc(asize);
+	if(new_location != NULL) {
+		memcpy(new_location, bp, copy_size);
+		PUT(HDRP(new_location), GET(HDRP(new_location)) | REALLOC_TAG);
 
-		// copy data one block down
-		memcpy(PREV_BLKP(bp), bp, copy_size);
-		bp = PREV_BLKP(bp); // ... and adjust bp
+		// ...and free the old block
+		heap_free(bp);
 	}
 
-	// if it worked, return bp directly
-	if(size <= GET_SIZE(HDRP(bp))-OVERHEAD) {
+	pthread_mutex_unlock(&heap_lock);
+	return new_location;
+}
+
+/*
+ * mm_calloc
+ *  - Allocate a block for `nmemb` elements of `size` bytes, cleared to zero
+ *  - Slots are cleared, mapped blocks are zero already
+ *  - For a heap block the bytes from mem_heap_fresh() on (as it was
+ *    before the heap was extended) have never been used, only the free
+ *    list node at the start and the footer of the free block can be in them
+ *  note: this function is used by clients
+ *  @return pointer to the cleared block or NULL if nmemb * size overflows
+ */
+void* mm_calloc(size_t nmemb, size_t size) {
+	size_t bytes;
+	char* bp;
+	char* fresh;
+
+	if(size != 0 && nmemb > SIZE_MAX / size)
+		return NULL;
+	bytes = nmemb * size;
+
+	if(bytes <= SLAB_MAX_SIZE || bytes >= MMAP_THRESHOLD) {
+		bp = mm_malloc(bytes);
+		if(bp != NULL && bytes <= SLAB_MAX_SIZE)
+			memset(bp, 0, bytes);
 		return bp;
 	}
 
-	// Backup plan: We do reallocation with malloc...
-	new_location = mm_malloc(size);
-	if(new_location == NULL)
+	pthread_mutex_lock(&heap_lock);
+	fresh = mem_heap_fresh();
+	bp = heap_malloc(adjust_size(bytes));
+	if(bp != NULL) {
+		char* dirty_end = MAX(fresh, bp + sizeof(node));
+
+		if(dirty_end >= bp + bytes) {
+			memset(bp, 0, bytes);
+		} else {
+			memset(bp, 0, dirty_end - bp);
+			PUT(FTRP(bp), 0); // the last word of the block
+		}
+	}
+	pthread_mutex_unlock(&heap_lock);
+
+	return bp;
+}
+
+/*
+ * mm_memalign
+ *  - Allocate a block of `size` bytes whose address is a multiple
+ *    of `alignment` (a power of two)
+ *  - Up to ALIGNMENT this is mm_malloc, bigger alignments always get
+ *    a heap block (see heap_malloc_aligned), the part in front of the
+ *    aligned block stays free
+ *  note: this function is used by clients
+ *  @return pointer to the aligned block or NULL
+ */
+void* mm_memalign(size_t alignment, size_t size) {
+	void* bp;
+
+	if(alignment == 0 || (alignment & (alignment-1)) != 0)
 		return NULL;
-	memcpy(new_location, bp, copy_size);
+	if(alignment <= ALIGNMENT)
+		return mm_malloc(size);
 
-	// ...and free the old block
-	mm_free(bp);
+	pthread_mutex_lock(&heap_lock);
+	bp = heap_malloc_aligned(adjust_size(size), alignment);
+	pthread_mutex_unlock(&heap_lock);
 
-	return new_location;
+	return bp;
+}
+
+/*
+ * mm_aligned_alloc
+ *  - C11 aligned_alloc: like mm_memalign, but `size` has to be a
+ *    multiple of `alignment`
+ *  note: this function is used by clients
+ */
+void* mm_aligned_alloc(size_t alignment, size_t size) {
+	if(alignment == 0 || size % alignment != 0)
+		return NULL;
+
+	return mm_memalign(alignment, size);
+}
+
+/*
+ * mm_free_sized
+ *  - mm_free for a block of `size` bytes, size has to be the size it was
+ *    allocated (or last reallocated) with
+ *  - a slot goes into the cache bin of its size without a look at the
+ *    slab header (a slot which realloc kept for a smaller size ends up
+ *    in the bin of a smaller class, which it still serves), blocks
+ *    bigger than the biggest slot are never slots
+ *  note: this function is used by clients
+ */
+void mm_free_sized(void* bp, size_t size) {
+	if(size <= SLOT_SIZE(SLAB_CLASSES-1) && slab_of(bp) != NULL) {
+		tcache_free(SLAB_CLASS(size), bp);
+		return;
+	}
+
+	block_free(bp);
+}
+
+/*
+ * mm_malloc_batch
+ *  - Allocate `n` blocks of `size` bytes into out
+ *  - slots come from the thread cache and then straight from the slabs,
+ *    heap blocks from heap_malloc_batch, both with one lock for the batch
+ *  note: this function is used by clients
+ *  @return the number of blocks allocated, less than n if there is no more space
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void** out) {
+	size_t i = 0;
+
+	if(size <= SLAB_MAX_SIZE) {
+		int bin = SLAB_CLASS(size);
+		tcache_validate();
+
+		for(; i<n && tcache.bins[bin] != NULL; i++)
+			out[i] = tcache_pop(bin);
+		if(i < n) {
+			pthread_mutex_lock(&heap_lock);
+			for(; i<n && (out[i] = slab_alloc(bin)) != NULL; i++)
+				;
+			pthread_mutex_unlock(&heap_lock);
+		}
+		return i;
+	}
+
+	if(size >= MMAP_THRESHOLD) {
+		for(; i<n && (out[i] = mmap_malloc(size)) != NULL; i++)
+			;
+		return i;
+	}
+
+	pthread_mutex_lock(&heap_lock);
+	i = heap_malloc_batch(adjust_size(size), n, out);
+	pthread_mutex_unlock(&heap_lock);
+
+	return i;
 }
 
+/*
+ * mm_free_batch
+ *  - mm_free for the `n` blocks in ptrs
+ *  - slots go into the thread cache, heap_lock is taken once, by the
+ *    first block which needs it, and held for the rest of the batch
+ *  note: this function is used by clients
+ */
+void mm_free_batch(void** ptrs, size_t n) {
+	size_t i;
+	int locked = 0;
+
+	for(i=0; i<n; i++) {
+		void* bp = ptrs[i];
+		slab* s = slab_of(bp);
+
+		if(s != NULL) {
+			int bin = s->class;
+			tcache_validate();
+
+			if(tcache.counts[bin] >= TCACHE_MAX_COUNT) {
+				if(!locked)
+					pthread_mutex_lock(&heap_lock);
+				locked = 1;
+				tcache_flush(bin, TCACHE_BATCH);
+			}
+			tcache_push(bin, bp);
+			continue;
+		}
 
+		if(!locked)
+			pthread_mutex_lock(&heap_lock);
+		locked = 1;
+		if(IS_MAPPED(bp))
+			mmap_free(bp);
+		else
+			heap_free(bp);
+	}
 
+	if(locked)
+		pthread_mutex_unlock(&heap_lock);
+}
 
+/*
+ * mm_arena_create
+ *  - creates an empty arena which gets chunks of `chunk_size` bytes
+ *    (ARENA_CHUNK_SIZE if 0), the first one with the first block
+ *  note: this function is used by clients
+ *  @return the arena or NULL if there is no more space
+ */
+mm_arena_t* mm_arena_create(size_t chunk_size) {
+	mm_arena_t* arena = mm_malloc(sizeof(mm_arena_t));
+
+	if(arena == NULL)
+		return NULL;
+	arena->chunks = NULL;
+	arena->bump = NULL;
+	arena->end = NULL;
+	arena->chunk_size = chunk_size ? ALIGN(chunk_size) : ARENA_CHUNK_SIZE;
+
+	return arena;
+}
+
+/*
+ * mm_arena_alloc
+ *  - Allocate a block of `size` bytes from an arena by bumping the
+ *    pointer of its first chunk
+ *  - if the block doesn't fit, a block over 1/ARENA_BIG_RATIO of a chunk
+ *    gets a chunk of its own (behind the first one, whose rest we keep
+ *    using), any other block a new first chunk
+ *  note: this function is used by clients
+ *  @return pointer to the block or NULL if there is no more space
+ */
+void* mm_arena_alloc(mm_arena_t* arena, size_t size) {
+	size_t asize = MAX(ALIGN(size), ALIGNMENT);
+	arena_chunk* chunk;
+	char* bp;
 
+	if(asize <= (size_t)(arena->end - arena->bump)) {
+		bp = arena->bump;
+		arena->bump += asize;
+		return bp;
+	}
 
+	if(arena->chunks != NULL && asize > arena->chunk_size / ARENA_BIG_RATIO) {
+		if((chunk = mm_malloc(ARENA_CHUNK_HEADER + asize)) == NULL)
+			return NULL;
+		chunk->size = asize;
+		chunk->next = arena->chunks->next;
+		arena->chunks->next = chunk;
+		return (char*)chunk + ARENA_CHUNK_HEADER;
+	}
 
+	if((chunk = mm_malloc(ARENA_CHUNK_HEADER + MAX(asize, arena->chunk_size))) == NULL)
+		return NULL;
+	chunk->size = MAX(asize, arena->chunk_size);
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
 
+	bp = (char*)chunk + ARENA_CHUNK_HEADER;
+	arena->bump = bp + asize;
+	arena->end = bp + chunk->size;
+	return bp;
+}
 
+/*
+ * mm_arena_reset
+ *  - frees all blocks of an arena at once: all chunks but the first go
+ *    back with mm_free, the first one is reused from its start
+ *  note: this function is used by clients
+ */
+void mm_arena_reset(mm_arena_t* arena) {
+	arena_chunk* chunk;
 
+	if(arena->chunks == NULL)
+		return;
 
+	while((chunk = arena->chunks->next) != NULL) {
+		arena->chunks->next = chunk->next;
+		mm_free(chunk);
+	}
+	arena->bump = (char*)arena->chunks + ARENA_CHUNK_HEADER;
+	arena->end = arena->bump + arena->chunks->size;
+}
 
+/*
+ * mm_arena_destroy
+ *  - frees all chunks of an arena and the arena itself
+ *  note: this function is used by clients
+ */
+void mm_arena_destroy(mm_arena_t* arena) {
+	mm_arena_reset(arena);
+	if(arena->chunks != NULL)
+		mm_free(arena->chunks);
+	mm_free(arena);
+}
@@ -4,6 +4,74 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern int mm_check(void);
+
+/* 
+ * Arenas: mm_arena_alloc() bumps a pointer through big chunks which
+ * come from mm_malloc(), its blocks are not freed one by one but all
+ * at once by mm_arena_reset() or mm_arena_destroy(). chunk_size 0 picks
+ * a default. An arena must not be used by two threads at the same time.
+ */
+typedef struct mm_arena mm_arena_t;
+
+extern mm_arena_t *mm_arena_create(size_t chunk_size);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+/* 
+ * Statistics of the allocator, filled in by mm_stats(). Sizes are in
+ * bytes and include the block headers. Free blocks are counted in bins
+ * by size: bin i holds the blocks of 2^i up to 2^(i+1)-1 bytes.
+ */
+#define MM_STATS_BINS 32
+
+typedef struct {
+    /* state of the heap when mm_stats is called */
+    size_t heap_size;      /* size of the heap */
+    size_t mapped_size;    /* size of the regions of mapped blocks */
+    size_t used_bytes;     /* allocated blocks and slots */
+    size_t pending_bytes;  /* freed blocks which aren't coalesced yet */
+    size_t slab_bytes;     /* unused parts of slabs */
+    size_t free_bytes;     /* blocks in the free lists */
+    size_t free_blocks;    /* number of blocks in the free lists */
+    size_t largest_free;   /* biggest block in the free lists */
+    size_t free_bins[MM_STATS_BINS]; /* free bytes by block size */
+    double ext_frag;       /* external fragmentation, 1 - largest_free/free_bytes */
+
+    /* events since mm_init */
+    unsigned long extends;      /* heap extensions */
+    unsigned long trims;        /* heap trims */
+    unsigned long coalesces;    /* free blocks merged with a neighbour */
+    unsigned long splits;       /* blocks split to place a request */
+    unsigned long searches;     /* free list searches */
+    unsigned long search_steps; /* blocks looked at by the searches */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *stats);
+
+/* 
+ * mm_walk() calls fn for every block of the heap in address order with
+ * the address of its header, its size and one of these states. Pending
+ * blocks are marked allocated, so they are reported as MM_BLOCK_USED
+ * and once more as MM_BLOCK_PENDING after the walk. A slab is reported
+ * in runs, like mm_stats() counts it: its used slots as MM_BLOCK_USED,
+ * its header and unused slots as MM_BLOCK_SLAB.
+ */
+#define MM_BLOCK_FREE 0     /* in the free lists */
+#define MM_BLOCK_USED 1     /* allocated (or a used slot) */
+#define MM_BLOCK_SLAB 2     /* unused part of a slab */
+#define MM_BLOCK_PENDING 3  /* freed but not coalesced yet */
+
+typedef void (*mm_walk_fn)(void *arg, void *start, size_t size, int state);
+
+extern void mm_walk(mm_walk_fn fn, void *arg);
 
 
 /* 
@@ -0,0 +1,96 @@
+/*
+ * rep2bin.c - converts a text trace (.rep) into a binary trace which
+ *     mdriver can mmap (see tracefmt.h)
+ *
+ *	unix> rep2bin traces/amptjp-bal.rep amptjp-bal.bin
+ *	unix> mdriver -f amptjp-bal.bin
+ *
+ *     A request line may end with a thread number (see tracecap.c),
+ *     it is dropped.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracefmt.h"
+
+#define MAXLINE 1024
+
+/*
+ * fail - prints an error message and exits
+ */
+static void fail(char *msg, char *path, long line)
+{
+    if (line > 0)
+	fprintf(stderr, "rep2bin: %s (%s, line %ld)\n", msg, path, line);
+    else
+	fprintf(stderr, "rep2bin: %s (%s)\n", msg, path);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    char line[MAXLINE], type[MAXLINE];
+    trace_header_t header;
+    trace_record_t rec;
+    unsigned index, size;
+    long lineno = 0, ops = 0;
+
+    if (argc != 3) {
+	fprintf(stderr, "Usage: rep2bin <in.rep> <out.bin>\n");
+	exit(1);
+    }
+    if ((in = fopen(argv[1], "r")) == NULL)
+	fail("could not open input", argv[1], 0);
+
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    if (fscanf(in, "%d %d %d %d", &header.sugg_heapsize, &header.num_ids,
+	       &header.num_ops, &header.weight) != 4 ||
+	header.num_ids < 0 || header.num_ops < 0)
+	fail("bad header", argv[1], 0);
+
+    if ((out = fopen(argv[2], "wb")) == NULL)
+	fail("could not open output", argv[2], 0);
+    fwrite(&header, sizeof(header), 1, out);
+
+    /* the rest of the last header line is the first line we get */
+    while (fgets(line, MAXLINE, in) != NULL) {
+	lineno++;
+	if (sscanf(line, "%s", type) != 1)
+	    continue;
+	size = 0;
+	switch (type[0]) {
+	case 'a':
+	    rec.type = TRACE_ALLOC;
+	    if (sscanf(line, "%*s %u %u", &index, &size) != 2)
+		fail("bad request", argv[1], lineno);
+	    break;
+	case 'r':
+	    rec.type = TRACE_REALLOC;
+	    if (sscanf(line, "%*s %u %u", &index, &size) != 2)
+		fail("bad request", argv[1], lineno);
+	    break;
+	case 'f':
+	    rec.type = TRACE_FREE;
+	    if (sscanf(line, "%*s %u", &index) != 1)
+		fail("bad request", argv[1], lineno);
+	    break;
+	default:
+	    fail("bogus request type", argv[1], lineno);
+	}
+	if (index >= (unsigned)header.num_ids)
+	    fail("id out of range", argv[1], lineno);
+	rec.index = index;
+	rec.size = size;
+	fwrite(&rec, sizeof(rec), 1, out);
+	ops++;
+    }
+    if (ops != header.num_ops)
+	fail("number of requests doesn't match the header", argv[1], 0);
+
+    fclose(in);
+    if (fclose(out) != 0)
+	fail("could not write output", argv[2], 0);
+    return 0;
+}
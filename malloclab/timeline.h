@@ -0,0 +1,38 @@
+#ifndef __TIMELINE_H_
+#define __TIMELINE_H_
+
+/*
+ * timeline.h - the heap timeline format
+ *
+ * mdriver -H writes snapshots of the heap layout of the mm package
+ * (from mm_walk) every few requests, heapviz renders them. The file
+ * starts with TIMELINE_MAGIC, then come the snapshots, each of them a
+ * snapshot_header_t followed by its block records. Numbers are stored
+ * in the byte order of the machine that wrote the file.
+ */
+#include <stdint.h>
+
+#define TIMELINE_MAGIC "MMHEAPTL"  /* first 8 bytes of a timeline */
+
+typedef struct {
+    int32_t trace;          /* number of the trace in the run */
+    int32_t op;             /* requests of the trace done so far */
+    uint32_t heap_size;     /* bytes of the heap */
+    uint32_t num_blocks;    /* block records behind this header */
+} snapshot_header_t;
+
+/*
+ * A block record, offset is the address of the block header minus
+ * mem_heap_lo(). Block sizes (and the runs of a slab) are multiples
+ * of 4, so the low 2 bits of size_state hold the state of the block
+ * (MM_BLOCK_* of mm.h).
+ */
+typedef struct {
+    uint32_t offset;
+    uint32_t size_state;
+} block_record_t;
+
+#define RECORD_SIZE(r) ((r)->size_state & ~3u)
+#define RECORD_STATE(r) ((r)->size_state & 3u)
+
+#endif /* __TIMELINE_H_ */
@@ -0,0 +1,425 @@
+/*
+ * tracecap.c - records the malloc, calloc, realloc and free calls of a
+ *     program as a trace file for mdriver (the .rep format). It is
+ *     built as a shared library and preloaded:
+ *
+ *	unix> make libtracecap.so
+ *	unix> TRACECAP_FILE=ls.rep LD_PRELOAD=./libtracecap.so ls
+ *	unix> mdriver -f ls.rep
+ *
+ *     Every block a program allocates gets the next free id, realloc
+ *     keeps the id of the block. malloc(0) is recorded as a request of
+ *     one byte (mdriver can't check empty payloads). Blocks of other
+ *     allocation functions (memalign, ...) are not recorded, and neither
+ *     are their frees. With TRACECAP_THREADS=1 every request line ends
+ *     with the number of the thread which made it. The trace is
+ *     written when the program exits, TRACECAP_FILE defaults to
+ *     "trace.rep". A child process (fork) is not recorded.
+ */
+#define _GNU_SOURCE /* RTLD_NEXT */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* the allocator of the program */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+
+/* dlsym may allocate before we know the real functions */
+#define BOOT_SIZE 4096
+static char boot_heap[BOOT_SIZE];
+static size_t boot_used;
+static int resolving;
+#define IS_BOOT(p) ((char *)(p) >= boot_heap && (char *)(p) < boot_heap + BOOT_SIZE)
+
+/* set while a thread is inside the recorder, allocations made by
+   the recorder itself (stdio, ...) are not recorded */
+static __thread int in_hook;
+static __thread int thread_no;   /* number of the thread + 1, 0 if not known yet */
+
+/* the recorder, protected by cap_lock */
+static pthread_mutex_t cap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int cap_state;            /* 0: not started, 1: recording, -1: off */
+static int cap_threads;          /* append thread numbers (TRACECAP_THREADS) */
+static int cap_fd = -1;          /* the request lines go to a temporary file */
+static char cap_path[4096];      /* name of the trace file */
+static char cap_tmp[4096 + 8];   /* name of the temporary file */
+static char out_buf[1 << 16];
+static size_t out_len;
+static unsigned long num_ids, num_ops, num_threads;
+static size_t live_bytes, peak_bytes;
+
+/* map from the address of a live block to its id and size, open
+   addressing with linear probing, map_size is a power of two */
+typedef struct {
+    void *p;                     /* NULL: empty slot */
+    unsigned long id;
+    size_t size;
+} slot_t;
+static slot_t *map;
+static size_t map_size, map_used;
+
+/*
+ * map_hash - returns the home slot of block p
+ */
+static size_t map_hash(void *p)
+{
+    uint64_t h = ((uintptr_t)p >> 4) * 0x9E3779B97F4A7C15ULL;
+
+    return (size_t)(h >> 24) & (map_size - 1);
+}
+
+/*
+ * map_insert - puts a block into the map (which has room for it)
+ */
+static void map_insert(void *p, unsigned long id, size_t size)
+{
+    size_t i = map_hash(p);
+
+    while (map[i].p != NULL)
+	i = (i + 1) & (map_size - 1);
+    map[i].p = p;
+    map[i].id = id;
+    map[i].size = size;
+    map_used++;
+}
+
+/*
+ * map_put - puts a block into the map, it is grown (with mmap, not with
+ *     the allocator we record) if it gets half full
+ *     return 0 if there is no memory for the map
+ */
+static int map_put(void *p, unsigned long id, size_t size)
+{
+    if (2 * (map_used + 1) > map_size) {
+	slot_t *old = map;
+	size_t i, old_size = map_size;
+	size_t new_size = old_size ? 2 * old_size : 1 << 16;
+	slot_t *new_map = mmap(NULL, new_size * sizeof(slot_t), PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (new_map == MAP_FAILED)
+	    return 0;
+	map = new_map;
+	map_size = new_size;
+	map_used = 0;
+	for (i = 0; i < old_size; i++)
+	    if (old[i].p != NULL)
+		map_insert(old[i].p, old[i].id, old[i].size);
+	if (old != NULL)
+	    munmap(old, old_size * sizeof(slot_t));
+    }
+    map_insert(p, id, size);
+    return 1;
+}
+
+/*
+ * map_remove - takes a block out of the map (the entries behind it are
+ *     moved up, so there are no deleted markers)
+ *     return 1 and the id and size of the block, 0 if it is not in the map
+ */
+static int map_remove(void *p, unsigned long *id, size_t *size)
+{
+    size_t i, j, k, mask = map_size - 1;
+
+    if (map_size == 0)
+	return 0;
+    for (i = map_hash(p); map[i].p != p; i = (i + 1) & mask)
+	if (map[i].p == NULL)
+	    return 0;
+    *id = map[i].id;
+    *size = map[i].size;
+
+    for (j = i; ; ) {
+	j = (j + 1) & mask;
+	if (map[j].p == NULL)
+	    break;
+	k = map_hash(map[j].p);
+	/* the entry at j can fill the hole at i if its home slot k is
+	   not (cyclically) in (i, j] */
+	if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+	    continue;
+	map[i] = map[j];
+	i = j;
+    }
+    map[i].p = NULL;
+    map_used--;
+    return 1;
+}
+
+/*
+ * out_flush - writes the buffered request lines to the temporary file
+ */
+static void out_flush(void)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < out_len && (n = write(cap_fd, out_buf + done, out_len - done)) > 0)
+	done += n;
+    out_len = 0;
+}
+
+/*
+ * record - adds a request line (a, r or f) to the trace
+ */
+static void record(char type, unsigned long id, size_t size)
+{
+    char *line;
+    int n;
+
+    if (out_len + 64 > sizeof(out_buf))
+	out_flush();
+    line = out_buf + out_len;
+    if (type == 'f')
+	n = sprintf(line, "f %lu", id);
+    else
+	n = sprintf(line, "%c %lu %lu", type, id, (unsigned long)size);
+    if (cap_threads) {
+	if (thread_no == 0)
+	    thread_no = ++num_threads;
+	n += sprintf(line + n, " %d", thread_no - 1);
+    }
+    line[n++] = '\n';
+    out_len += n;
+    num_ops++;
+}
+
+/*
+ * cap_child - turns the recorder off in a child process, it would
+ *     write to the same files
+ */
+static void cap_child(void)
+{
+    cap_state = -1;
+}
+
+/*
+ * cap_start - opens the temporary file on the first request
+ *     return 1 if we are recording
+ */
+static int cap_start(void)
+{
+    char *s;
+
+    if (cap_state != 0)
+	return cap_state > 0;
+
+    cap_state = -1;
+    s = getenv("TRACECAP_FILE");
+    strncpy(cap_path, (s && *s) ? s : "trace.rep", sizeof(cap_path) - 1);
+    s = getenv("TRACECAP_THREADS");
+    cap_threads = (s && *s == '1');
+    sprintf(cap_tmp, "%s.tmp", cap_path);
+    if ((cap_fd = open(cap_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	return 0;
+    pthread_atfork(NULL, NULL, cap_child);
+    cap_state = 1;
+    return 1;
+}
+
+/*
+ * cap_alloc - records a new block p of size bytes
+ */
+static void cap_alloc(void *p, size_t size)
+{
+    if (size == 0)
+	size = 1;
+    pthread_mutex_lock(&cap_lock);
+    if (cap_start() && map_put(p, num_ids, size)) {
+	record('a', num_ids++, size);
+	live_bytes += size;
+	if (live_bytes > peak_bytes)
+	    peak_bytes = live_bytes;
+    }
+    pthread_mutex_unlock(&cap_lock);
+}
+
+/*
+ * cap_free - records the free of block p (if we know it)
+ *     note: cap_lock has to be held
+ */
+static void cap_free(void *p)
+{
+    unsigned long id;
+    size_t size;
+
+    if (cap_state > 0 && map_remove(p, &id, &size)) {
+	record('f', id, 0);
+	live_bytes -= size;
+    }
+}
+
+/*
+ * resolve - looks up the functions of the real allocator
+ */
+static void resolve(void)
+{
+    resolving = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    resolving = 0;
+}
+
+/*
+ * boot_alloc - serves the allocations of dlsym (zeroed, never freed)
+ */
+static void *boot_alloc(size_t size)
+{
+    void *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (boot_used + size > BOOT_SIZE)
+	return NULL;
+    p = boot_heap + boot_used;
+    boot_used += size;
+    return p;
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+	if (resolving)
+	    return boot_alloc(size);
+	resolve();
+    }
+    p = real_malloc(size);
+    if (p != NULL && !in_hook) {
+	in_hook = 1;
+	cap_alloc(p, size);
+	in_hook = 0;
+    }
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL) {
+	if (resolving)
+	    return boot_alloc(nmemb * size);
+	resolve();
+    }
+    p = real_calloc(nmemb, size);
+    if (p != NULL && !in_hook) {
+	in_hook = 1;
+	cap_alloc(p, nmemb * size);
+	in_hook = 0;
+    }
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+    unsigned long id;
+    size_t old_size;
+
+    if (real_realloc == NULL)
+	resolve();
+    if (ptr == NULL)
+	return malloc(size);
+    if (IS_BOOT(ptr)) {
+	if ((p = malloc(size)) != NULL)
+	    memcpy(p, ptr, size < BOOT_SIZE - ((char *)ptr - boot_heap) ?
+		   size : BOOT_SIZE - ((char *)ptr - boot_heap));
+	return p;
+    }
+    if (in_hook)
+	return real_realloc(ptr, size);
+
+    /* hold the lock, the old address must not be reused before
+       it is out of the map */
+    in_hook = 1;
+    pthread_mutex_lock(&cap_lock);
+    p = real_realloc(ptr, size);
+    if (p == NULL && size == 0) {
+	cap_free(ptr);
+    } else if (p != NULL && cap_start()) {
+	if (size == 0)
+	    size = 1;
+	if (!map_remove(ptr, &id, &old_size)) {
+	    /* a block we don't know, from now on we do */
+	    id = num_ids++;
+	    old_size = 0;
+	    record('a', id, size);
+	} else {
+	    record('r', id, size);
+	}
+	if (map_put(p, id, size))
+	    live_bytes += size - old_size;
+	else
+	    live_bytes -= old_size;
+	if (live_bytes > peak_bytes)
+	    peak_bytes = live_bytes;
+    }
+    pthread_mutex_unlock(&cap_lock);
+    in_hook = 0;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || IS_BOOT(ptr))
+	return;
+    if (real_free == NULL)
+	resolve();
+    if (!in_hook) {
+	/* out of the map before the address can be reused */
+	in_hook = 1;
+	pthread_mutex_lock(&cap_lock);
+	cap_free(ptr);
+	pthread_mutex_unlock(&cap_lock);
+	in_hook = 0;
+    }
+    real_free(ptr);
+}
+
+/*
+ * cap_finish - writes the trace file when the program exits: the
+ *     header (suggested heap size = peak of the live bytes, number of
+ *     ids, number of requests, weight) and the request lines
+ */
+__attribute__((destructor))
+static void cap_finish(void)
+{
+    char header[128], buf[1 << 16];
+    int fd, in, n;
+
+    in_hook = 1;
+    pthread_mutex_lock(&cap_lock);
+    if (cap_state <= 0) {
+	pthread_mutex_unlock(&cap_lock);
+	return;
+    }
+    cap_state = -1;
+    out_flush();
+    close(cap_fd);
+
+    if ((fd = open(cap_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0 &&
+	(in = open(cap_tmp, O_RDONLY)) >= 0) {
+	n = sprintf(header, "%lu\n%lu\n%lu\n1\n",
+		    (unsigned long)peak_bytes, num_ids, num_ops);
+	if (write(fd, header, n) == n)
+	    while ((n = read(in, buf, sizeof(buf))) > 0 && write(fd, buf, n) == n)
+		;
+	close(in);
+    }
+    if (fd >= 0)
+	close(fd);
+    unlink(cap_tmp);
+    pthread_mutex_unlock(&cap_lock);
+}
@@ -0,0 +1,37 @@
+#ifndef __TRACEFMT_H_
+#define __TRACEFMT_H_
+
+/*
+ * tracefmt.h - the binary trace format
+ *
+ * A binary trace holds the same information as a .rep file: a fixed
+ * header followed by num_ops request records. The records have the
+ * layout of traceop_t in mdriver.c, so the driver can mmap the file
+ * and use the records as they are. Numbers are stored in the byte
+ * order of the machine that wrote the file (rep2bin converts a .rep
+ * file).
+ */
+#include <stdint.h>
+
+#define TRACE_MAGIC "MMTRACE1"  /* first 8 bytes of a binary trace */
+
+typedef struct {
+    char magic[8];              /* TRACE_MAGIC */
+    int32_t sugg_heapsize;      /* suggested heap size (unused) */
+    int32_t num_ids;            /* number of alloc/realloc ids */
+    int32_t num_ops;            /* number of records behind the header */
+    int32_t weight;             /* weight for this trace (unused) */
+} trace_header_t;
+
+/* Request types of a record */
+#define TRACE_ALLOC 0
+#define TRACE_FREE 1
+#define TRACE_REALLOC 2
+
+typedef struct {
+    int32_t type;               /* TRACE_ALLOC, TRACE_FREE or TRACE_REALLOC */
+    int32_t index;              /* id of the block, less than num_ids */
+    int32_t size;               /* byte size of alloc/realloc request */
+} trace_record_t;
+
+#endif /* __TRACEFMT_H_ */
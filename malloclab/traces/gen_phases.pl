@@ -0,0 +1,49 @@
+#!/usr/bin/perl
+#
+# gen_phases.pl - generates phases-bal.rep, a trace of a server which
+#     handles one request per phase: every phase allocates a few
+#     hundred small blocks and some bigger ones, grows a few of them
+#     with realloc and frees some early, and frees the rest at its
+#     end, in random order. No block outlives its phase, so mdriver -A
+#     resets its arena at the end of every phase.
+#
+use strict;
+
+my $phases = 60;
+my @ops = ();
+my $ids = 0;
+
+srand(17);
+for my $phase (1 .. $phases) {
+    my @live = ();
+    my $n = 100 + int(rand(300));
+
+    for (1 .. $n) {
+	my $size = (rand() < 0.8) ? 8 + int(rand(120)) : 128 + int(rand(2000));
+	push(@ops, "a $ids $size");
+	push(@live, [$ids, $size]);
+	$ids++;
+
+	if (rand() < 0.1) {          # grow a block (a string, a buffer)
+	    my $b = $live[int(rand(@live))];
+	    $b->[1] = 2 * $b->[1] + int(rand(64));
+	    $b->[1] = 8192 if $b->[1] > 8192;
+	    push(@ops, "r $b->[0] $b->[1]");
+	}
+	if (rand() < 0.2 && @live > 1) { # a temporary dies early
+	    my ($b) = splice(@live, int(rand(@live)), 1);
+	    push(@ops, "f $b->[0]");
+	}
+    }
+
+    # the end of the request
+    while (@live) {
+	my ($b) = splice(@live, int(rand(@live)), 1);
+	push(@ops, "f $b->[0]");
+    }
+}
+
+open(my $out, ">", "phases-bal.rep") or die "gen_phases.pl: $!\n";
+print $out "20000000\n$ids\n", scalar(@ops), "\n1\n";
+print $out "$_\n" for @ops;
+close($out) or die "gen_phases.pl: $!\n";
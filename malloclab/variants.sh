@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# variants.sh - runs mdriver and the drivers with other allocator
+#     policies (make variants, see the Makefile) over the traces and
+#     prints their utilization and throughput (Kops) side by side
+#
+#	unix> make variants
+#	unix> ./variants.sh
+#	unix> ./variants.sh -t traces/ first best
+#
+#     Flags before the variant names go to mdriver, without names all
+#     variants the Makefile knows are run.
+#
+cd "$(dirname "$0")" || exit 1
+
+flags=""
+while [ $# -gt 0 ] && [ "${1#-}" != "$1" ]; do
+    case "$1" in
+    -t|-f) flags="$flags $1 $2"; shift 2 ;;
+    *) flags="$flags $1"; shift ;;
+    esac
+done
+if [ $# -eq 0 ]; then
+    set -- $(sed -n 's/^VARIANTS *= *//p' Makefile)
+fi
+
+drivers="mdriver"
+for v in "$@"; do
+    if [ ! -x "mdriver-$v" ]; then
+        echo "variants.sh: mdriver-$v is missing, run make variants" >&2
+        exit 1
+    fi
+    drivers="$drivers mdriver-$v"
+done
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+# one column per driver: a heading and util/Kops per trace and in total
+for d in $drivers; do
+    name=${d#mdriver-}
+    [ "$d" = mdriver ] && name=default
+    ./$d -v -a $flags > "$tmp/out.$d" 2>&1
+    awk -v name="$name" '
+        # columns of printresults: util 13-18, ops 19-26, secs 27-36
+        function row(util) {
+            secs = substr($0, 27, 10) + 0
+            kops = (secs > 0) ? substr($0, 19, 8) / secs / 1e3 : 0
+            printf "%10s%7.0f\n", util, kops
+        }
+        BEGIN { printf "%16s\n%16s\n", name, "util   Kops" }
+        /^Results for mm malloc/ { mm = 1; next }
+        mm && $2 == "yes" { row($3) }
+        mm && $2 == "no" { printf "%10s%7s\n", "-", "-" }
+        mm && $1 == "Total" { row($2); mm = 0 }
+    ' "$tmp/out.$d" > "$tmp/$d"
+    if grep -q "ERROR" "$tmp/out.$d"; then
+        echo "variants.sh: $d reported errors:" >&2
+        grep "ERROR" "$tmp/out.$d" | head -3 >&2
+    fi
+done
+
+# the trace numbers (and Total) from the run of mdriver
+awk 'BEGIN { printf "%5s\n%5s\n", "trace", "" }
+     /^Results for mm malloc/ { mm = 1; next }
+     mm && ($2 == "yes" || $2 == "no") { printf "%5s\n", $1 }
+     mm && $1 == "Total" { printf "%5s\n", "Total"; mm = 0 }' \
+    "$tmp/out.mdriver" > "$tmp/traces"
+
+cd "$tmp" && paste -d "" traces $drivers